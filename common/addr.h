@@ -0,0 +1,74 @@
+/*
+ * IEEE 802.15.4 socket addresses and their hash table keys
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_COMMON_ADDR_H
+#define __WPAN_COMMON_ADDR_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define IEEE802154_ADDR_LEN 8
+
+enum {
+	IEEE802154_ADDR_NONE = 0x0,
+	IEEE802154_ADDR_SHORT = 0x2,
+	IEEE802154_ADDR_LONG = 0x3,
+};
+
+struct ieee802154_addr_sa {
+	int addr_type;
+	uint16_t pan_id;
+	union {
+		uint8_t hwaddr[IEEE802154_ADDR_LEN];
+		uint16_t short_addr;
+	};
+};
+
+struct sockaddr_ieee802154 {
+	sa_family_t family;
+	struct ieee802154_addr_sa addr;
+};
+
+/* Short addresses as they are, extended ones as one big endian number */
+static inline uint64_t addr_key(const struct ieee802154_addr_sa *sa)
+{
+	uint64_t key = 0;
+	int i;
+
+	if (sa->addr_type != IEEE802154_ADDR_LONG)
+		return sa->short_addr;
+
+	for (i = 0; i < IEEE802154_ADDR_LEN; i++)
+		key = (key << 8) | sa->hwaddr[i];
+	return key;
+}
+
+/*
+ * Slot of an address in a hash table of size entries, a power of two.
+ * splitmix64 finalizer over key, address type and PAN, short addresses are
+ * far from uniformly spread and repeat across PANs.
+ */
+static inline unsigned int addr_hash(uint64_t key, int type, uint16_t pan,
+				     unsigned int size)
+{
+	key ^= (uint64_t)type << 56 ^ (uint64_t)pan << 40;
+	key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key & (size - 1);
+}
+
+#endif /* __WPAN_COMMON_ADDR_H */
@@ -0,0 +1,118 @@
+/*
+ * Channel center frequencies of the IEEE 802.15.4 channel pages
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "freq.h"
+
+float ieee802154_channel_freq(int channel_page, int channel)
+{
+	float freq = 0;
+
+	switch (channel_page) {
+	case 0:
+		if (channel == 0)
+			freq = 868.3;
+		else if (channel > 0 && channel < 11)
+			freq = 906 + 2 * (channel - 1);
+		else
+			freq = 2405 + 5 * (channel - 11);
+		break;
+	case 1:
+	case 2:
+		if (channel == 0)
+			freq = 868.3;
+		else if (channel >= 1 && channel <= 10)
+			freq = 906 + 2 * (channel - 1);
+		break;
+	case 3:
+		if (channel >= 0 && channel <= 12)
+			freq = 2412 + 5 * channel;
+		else if (channel == 13)
+			freq = 2484;
+		break;
+	case 4:
+		switch (channel) {
+		case 0:
+			freq = 499.2;
+			break;
+		case 1:
+			freq = 3494.4;
+			break;
+		case 2:
+			freq = 3993.6;
+			break;
+		case 3:
+			freq = 4492.8;
+			break;
+		case 4:
+			freq = 3993.6;
+			break;
+		case 5:
+			freq = 6489.6;
+			break;
+		case 6:
+			freq = 6988.8;
+			break;
+		case 7:
+			freq = 6489.6;
+			break;
+		case 8:
+			freq = 7488.0;
+			break;
+		case 9:
+			freq = 7987.2;
+			break;
+		case 10:
+			freq = 8486.4;
+			break;
+		case 11:
+			freq = 7987.2;
+			break;
+		case 12:
+			freq = 8985.6;
+			break;
+		case 13:
+			freq = 9484.8;
+			break;
+		case 14:
+			freq = 9984.0;
+			break;
+		case 15:
+			freq = 9484.8;
+			break;
+		}
+		break;
+	case 5:
+		if (channel >= 0 && channel <= 3)
+			freq = 780 + 2 * channel;
+		else if (channel >= 4 && channel <= 7)
+			freq = 780 + 2 * (channel - 4);
+		break;
+	case 6:
+		if (channel >= 0 && channel <= 7)
+			freq = 951.2 + 0.6 * channel;
+		else if (channel >= 8 && channel <= 9)
+			freq = 954.4 + 0.2 * (channel - 8);
+		else if (channel >= 10  && channel <= 21)
+			freq = 951.1 + 0.4 * (channel - 10);
+		break;
+	}
+
+	return freq;
+}
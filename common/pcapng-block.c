@@ -0,0 +1,57 @@
+/*
+ * pcapng blocks shared by the wpan-ping capture and wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "pcapng-block.h"
+
+size_t write_headers(uint8_t *block, const char *appl, const char *ifname,
+		     uint16_t linktype, uint8_t tsresol)
+{
+	uint8_t *p, *start;
+	uint32_t len;
+
+	start = block;
+	p = put_u32(block, PCAPNG_SHB);
+	p = put_u32(p, 0);
+	p = put_u32(p, PCAPNG_BYTE_ORDER_MAGIC);
+	p = put_u16(p, 1);
+	p = put_u16(p, 0);
+	p = put_u32(p, 0xffffffff); /* section length unknown */
+	p = put_u32(p, 0xffffffff);
+	p = put_option(p, PCAPNG_SHB_USERAPPL, appl, strlen(appl));
+	p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+	len = p - start + 4;
+	p = put_u32(p, len);
+	put_u32(start + 4, len);
+
+	start = p;
+	p = put_u32(p, PCAPNG_IDB);
+	p = put_u32(p, 0);
+	p = put_u16(p, linktype);
+	p = put_u16(p, 0);
+	p = put_u32(p, 0); /* no snap length */
+	p = put_option(p, PCAPNG_IF_NAME, ifname, strnlen(ifname, 64));
+	p = put_option(p, PCAPNG_IF_TSRESOL, &tsresol, sizeof(tsresol));
+	p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+	len = p - start + 4;
+	p = put_u32(p, len);
+	put_u32(start + 4, len);
+
+	return p - block;
+}
@@ -0,0 +1,75 @@
+/*
+ * pcapng blocks shared by the wpan-ping capture and wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_COMMON_PCAPNG_BLOCK_H
+#define __WPAN_COMMON_PCAPNG_BLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LINKTYPE_IEEE802_15_4_WITHFCS 195
+#define LINKTYPE_IEEE802_15_4_NOFCS 230
+
+#define PCAPNG_SHB 0x0a0d0d0a
+#define PCAPNG_IDB 0x00000001
+#define PCAPNG_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
+
+#define PCAPNG_OPT_END 0
+#define PCAPNG_SHB_USERAPPL 4
+#define PCAPNG_IF_NAME 2
+#define PCAPNG_IF_TSRESOL 9
+#define PCAPNG_EPB_FLAGS 2
+#define PCAPNG_EPB_INBOUND 0x1
+#define PCAPNG_EPB_OUTBOUND 0x2
+
+/* Room for the section header and one interface description */
+#define PCAPNG_HEADERS_MAX 256
+
+/* Blocks are written in host byte order, the byte order magic tells readers */
+static inline uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static inline uint8_t *put_option(uint8_t *p, uint16_t code, const void *val,
+				  size_t len)
+{
+	size_t padded = (len + 3) & ~(size_t)3;
+
+	p = put_u16(p, code);
+	p = put_u16(p, len);
+	memset(p, 0, padded);
+	memcpy(p, val, len);
+	return p + padded;
+}
+
+/*
+ * Builds the section header and the description of interface 0 into block,
+ * tsresol as in if_tsresol, e.g. 6 for us. Returns the length of both.
+ */
+size_t write_headers(uint8_t *block, const char *appl, const char *ifname,
+		     uint16_t linktype, uint8_t tsresol);
+
+#endif /* __WPAN_COMMON_PCAPNG_BLOCK_H */
@@ -0,0 +1,389 @@
+/*
+ * nl802154 PHY and MAC control of wpan-ping and wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <net/if.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+
+#include "../src/nl802154.h"
+#include "phyctl.h"
+
+struct phyctl {
+	struct nl_sock *sock;
+	int nl802154_id;
+	char ifname[IFNAMSIZ];
+	unsigned int ifindex;
+	unsigned int wpan_phy;
+	/* Where the reply callbacks store what they parsed */
+	struct mac_params *mac;
+	struct phy_caps *caps;
+	int32_t *tx_power;
+	uint8_t *page;
+	uint8_t *channel;
+};
+
+static int phyctl_iface_cb(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct nlattr *tb[NL802154_ATTR_MAX + 1];
+	struct phyctl *pc = arg;
+
+	nla_parse(tb, NL802154_ATTR_MAX, genlmsg_attrdata(gnlh, 0),
+		  genlmsg_attrlen(gnlh, 0), NULL);
+
+	if (tb[NL802154_ATTR_WPAN_PHY])
+		pc->wpan_phy = nla_get_u32(tb[NL802154_ATTR_WPAN_PHY]);
+
+	if (!pc->mac)
+		return NL_SKIP;
+	if (tb[NL802154_ATTR_MIN_BE])
+		pc->mac->min_be = nla_get_u8(tb[NL802154_ATTR_MIN_BE]);
+	if (tb[NL802154_ATTR_MAX_BE])
+		pc->mac->max_be = nla_get_u8(tb[NL802154_ATTR_MAX_BE]);
+	if (tb[NL802154_ATTR_MAX_CSMA_BACKOFFS])
+		pc->mac->csma_backoffs = nla_get_u8(tb[NL802154_ATTR_MAX_CSMA_BACKOFFS]);
+	if (tb[NL802154_ATTR_MAX_FRAME_RETRIES])
+		pc->mac->frame_retries = nla_get_s8(tb[NL802154_ATTR_MAX_FRAME_RETRIES]);
+
+	return NL_SKIP;
+}
+
+static int phyctl_phy_cb(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct nlattr *tb[NL802154_ATTR_MAX + 1];
+	struct nlattr *tb_caps[NL802154_CAP_ATTR_MAX + 1];
+	struct phyctl *pc = arg;
+	struct phy_caps *caps = pc->caps;
+	struct nlattr *pwr, *page, *chan;
+	int rem, rem_chan;
+
+	nla_parse(tb, NL802154_ATTR_MAX, genlmsg_attrdata(gnlh, 0),
+		  genlmsg_attrlen(gnlh, 0), NULL);
+
+	if (pc->tx_power && tb[NL802154_ATTR_TX_POWER])
+		*pc->tx_power = nla_get_s32(tb[NL802154_ATTR_TX_POWER]);
+	if (pc->page && tb[NL802154_ATTR_PAGE] && tb[NL802154_ATTR_CHANNEL]) {
+		*pc->page = nla_get_u8(tb[NL802154_ATTR_PAGE]);
+		*pc->channel = nla_get_u8(tb[NL802154_ATTR_CHANNEL]);
+	}
+
+	if (!caps || !tb[NL802154_ATTR_WPAN_PHY_CAPS] ||
+	    nla_parse_nested(tb_caps, NL802154_CAP_ATTR_MAX,
+			     tb[NL802154_ATTR_WPAN_PHY_CAPS], NULL))
+		return NL_SKIP;
+
+	if (tb_caps[NL802154_CAP_ATTR_MIN_MINBE] && tb_caps[NL802154_CAP_ATTR_MAX_MINBE]) {
+		caps->min.min_be = nla_get_u8(tb_caps[NL802154_CAP_ATTR_MIN_MINBE]);
+		caps->max.min_be = nla_get_u8(tb_caps[NL802154_CAP_ATTR_MAX_MINBE]);
+	}
+	if (tb_caps[NL802154_CAP_ATTR_MIN_MAXBE] && tb_caps[NL802154_CAP_ATTR_MAX_MAXBE]) {
+		caps->min.max_be = nla_get_u8(tb_caps[NL802154_CAP_ATTR_MIN_MAXBE]);
+		caps->max.max_be = nla_get_u8(tb_caps[NL802154_CAP_ATTR_MAX_MAXBE]);
+	}
+	if (tb_caps[NL802154_CAP_ATTR_MIN_CSMA_BACKOFFS] &&
+	    tb_caps[NL802154_CAP_ATTR_MAX_CSMA_BACKOFFS]) {
+		caps->min.csma_backoffs = nla_get_u8(tb_caps[NL802154_CAP_ATTR_MIN_CSMA_BACKOFFS]);
+		caps->max.csma_backoffs = nla_get_u8(tb_caps[NL802154_CAP_ATTR_MAX_CSMA_BACKOFFS]);
+	}
+	if (tb_caps[NL802154_CAP_ATTR_MIN_FRAME_RETRIES] &&
+	    tb_caps[NL802154_CAP_ATTR_MAX_FRAME_RETRIES]) {
+		caps->min.frame_retries = nla_get_s8(tb_caps[NL802154_CAP_ATTR_MIN_FRAME_RETRIES]);
+		caps->max.frame_retries = nla_get_s8(tb_caps[NL802154_CAP_ATTR_MAX_FRAME_RETRIES]);
+	}
+
+	caps->num_tx_powers = 0;
+	if (tb_caps[NL802154_CAP_ATTR_TX_POWERS]) {
+		nla_for_each_nested(pwr, tb_caps[NL802154_CAP_ATTR_TX_POWERS], rem) {
+			if (caps->num_tx_powers == PHYCTL_MAX_TX_POWERS)
+				break;
+			caps->tx_powers[caps->num_tx_powers++] = nla_get_s32(pwr);
+		}
+	}
+
+	/* Pages nest their channels, both by attribute type */
+	if (tb_caps[NL802154_CAP_ATTR_CHANNELS]) {
+		nla_for_each_nested(page, tb_caps[NL802154_CAP_ATTR_CHANNELS], rem) {
+			if (nla_type(page) >= PHYCTL_MAX_PAGES)
+				continue;
+			nla_for_each_nested(chan, page, rem_chan) {
+				if (nla_type(chan) < 32)
+					caps->channels[nla_type(page)] |= 1U << nla_type(chan);
+			}
+		}
+	}
+
+	return NL_SKIP;
+}
+
+/* Commands address the interface by ifindex or, for CIB_PHY ones, the phy */
+static struct nl_msg *phyctl_msg(struct phyctl *pc, int cmd, bool phy)
+{
+	struct nl_msg *msg;
+
+	msg = nlmsg_alloc();
+	if (!msg)
+		return NULL;
+
+	genlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, pc->nl802154_id, 0, 0, cmd, 0);
+	if (phy)
+		NLA_PUT_U32(msg, NL802154_ATTR_WPAN_PHY, pc->wpan_phy);
+	else
+		NLA_PUT_U32(msg, NL802154_ATTR_IFINDEX, pc->ifindex);
+
+	return msg;
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return NULL;
+}
+
+static int phyctl_send(struct phyctl *pc, struct nl_msg *msg,
+		       nl_recvmsg_msg_cb_t cb, const char *what)
+{
+	int err;
+
+	if (!msg)
+		return -ENOMEM;
+
+	nl_socket_modify_cb(pc->sock, NL_CB_VALID, NL_CB_CUSTOM, cb, pc);
+	err = nl_send_sync(pc->sock, msg);
+	if (err < 0) {
+		fprintf(stderr, "%s on %s: %s\n", what, pc->ifname, nl_geterror(err));
+		return -EIO;
+	}
+
+	return 0;
+}
+
+struct phyctl *phyctl_open(const char *ifname)
+{
+	struct phyctl *pc;
+
+	pc = calloc(1, sizeof(*pc));
+	if (!pc)
+		return NULL;
+
+	snprintf(pc->ifname, sizeof(pc->ifname), "%s", ifname);
+	pc->ifindex = if_nametoindex(ifname);
+	if (!pc->ifindex) {
+		perror(ifname);
+		goto out_free;
+	}
+
+	pc->sock = nl_socket_alloc();
+	if (!pc->sock) {
+		fprintf(stderr, "Failed to allocate netlink socket.\n");
+		goto out_free;
+	}
+
+	if (genl_connect(pc->sock)) {
+		fprintf(stderr, "Failed to connect to generic netlink.\n");
+		goto out_sock;
+	}
+
+	pc->nl802154_id = genl_ctrl_resolve(pc->sock, "nl802154");
+	if (pc->nl802154_id < 0) {
+		fprintf(stderr, "nl802154 not found.\n");
+		goto out_sock;
+	}
+
+	/* Resolve the phy behind the interface once */
+	if (phyctl_send(pc, phyctl_msg(pc, NL802154_CMD_GET_INTERFACE, false),
+			phyctl_iface_cb, "get interface"))
+		goto out_sock;
+
+	return pc;
+
+out_sock:
+	nl_socket_free(pc->sock);
+out_free:
+	free(pc);
+	return NULL;
+}
+
+void phyctl_close(struct phyctl *pc)
+{
+	if (!pc)
+		return;
+	nl_socket_free(pc->sock);
+	free(pc);
+}
+
+int phyctl_get_caps(struct phyctl *pc, struct phy_caps *caps)
+{
+	int ret;
+
+	memset(caps, 0, sizeof(*caps));
+	pc->caps = caps;
+	ret = phyctl_send(pc, phyctl_msg(pc, NL802154_CMD_GET_WPAN_PHY, true),
+			  phyctl_phy_cb, "get phy");
+	pc->caps = NULL;
+	return ret;
+}
+
+int phyctl_get_tx_power(struct phyctl *pc, int32_t *mbm)
+{
+	int ret;
+
+	pc->tx_power = mbm;
+	ret = phyctl_send(pc, phyctl_msg(pc, NL802154_CMD_GET_WPAN_PHY, true),
+			  phyctl_phy_cb, "get phy");
+	pc->tx_power = NULL;
+	return ret;
+}
+
+int phyctl_get_channel(struct phyctl *pc, uint8_t *page, uint8_t *channel)
+{
+	int ret;
+
+	pc->page = page;
+	pc->channel = channel;
+	ret = phyctl_send(pc, phyctl_msg(pc, NL802154_CMD_GET_WPAN_PHY, true),
+			  phyctl_phy_cb, "get phy");
+	pc->page = NULL;
+	pc->channel = NULL;
+	return ret;
+}
+
+int phyctl_get_mac(struct phyctl *pc, struct mac_params *mac)
+{
+	int ret;
+
+	memset(mac, 0, sizeof(*mac));
+	pc->mac = mac;
+	ret = phyctl_send(pc, phyctl_msg(pc, NL802154_CMD_GET_INTERFACE, false),
+			  phyctl_iface_cb, "get interface");
+	pc->mac = NULL;
+	return ret;
+}
+
+/* Returns the previous state, or -1 if the flags could not be changed */
+static int phyctl_link(struct phyctl *pc, bool up)
+{
+	struct ifreq ifr;
+	int sd, was_up = -1;
+
+	sd = socket(PF_IEEE802154, SOCK_DGRAM, 0);
+	if (sd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&ifr, 0, sizeof(ifr));
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", pc->ifname);
+	if (ioctl(sd, SIOCGIFFLAGS, &ifr)) {
+		perror("SIOCGIFFLAGS");
+		goto out;
+	}
+
+	was_up = !!(ifr.ifr_flags & IFF_UP);
+	if (was_up == up)
+		goto out;
+
+	if (up)
+		ifr.ifr_flags |= IFF_UP;
+	else
+		ifr.ifr_flags &= ~IFF_UP;
+	if (ioctl(sd, SIOCSIFFLAGS, &ifr)) {
+		perror("SIOCSIFFLAGS");
+		was_up = -1;
+	}
+out:
+	close(sd);
+	return was_up;
+}
+
+int phyctl_set_mac(struct phyctl *pc, const struct mac_params *mac)
+{
+	struct nl_msg *msg;
+	int was_up, ret;
+
+	was_up = phyctl_link(pc, false);
+	if (was_up < 0)
+		return -EIO;
+
+	msg = phyctl_msg(pc, NL802154_CMD_SET_BACKOFF_EXPONENT, false);
+	if (msg && (nla_put_u8(msg, NL802154_ATTR_MIN_BE, mac->min_be) ||
+		    nla_put_u8(msg, NL802154_ATTR_MAX_BE, mac->max_be))) {
+		nlmsg_free(msg);
+		msg = NULL;
+	}
+	ret = phyctl_send(pc, msg, NULL, "set backoff_exponents");
+	if (ret)
+		goto out;
+
+	msg = phyctl_msg(pc, NL802154_CMD_SET_MAX_CSMA_BACKOFFS, false);
+	if (msg && nla_put_u8(msg, NL802154_ATTR_MAX_CSMA_BACKOFFS, mac->csma_backoffs)) {
+		nlmsg_free(msg);
+		msg = NULL;
+	}
+	ret = phyctl_send(pc, msg, NULL, "set max_csma_backoffs");
+	if (ret)
+		goto out;
+
+	msg = phyctl_msg(pc, NL802154_CMD_SET_MAX_FRAME_RETRIES, false);
+	if (msg && nla_put_s8(msg, NL802154_ATTR_MAX_FRAME_RETRIES, mac->frame_retries)) {
+		nlmsg_free(msg);
+		msg = NULL;
+	}
+	ret = phyctl_send(pc, msg, NULL, "set max_frame_retries");
+out:
+	if (was_up && phyctl_link(pc, true) < 0)
+		ret = -EIO;
+	return ret;
+}
+
+int phyctl_set_tx_power(struct phyctl *pc, int32_t mbm)
+{
+	struct nl_msg *msg;
+
+	msg = phyctl_msg(pc, NL802154_CMD_SET_TX_POWER, true);
+	if (msg && nla_put_s32(msg, NL802154_ATTR_TX_POWER, mbm)) {
+		nlmsg_free(msg);
+		msg = NULL;
+	}
+	return phyctl_send(pc, msg, NULL, "set tx_power");
+}
+
+int phyctl_set_channel(struct phyctl *pc, uint8_t page, uint8_t channel)
+{
+	struct nl_msg *msg;
+
+	msg = phyctl_msg(pc, NL802154_CMD_SET_CHANNEL, true);
+	if (msg && (nla_put_u8(msg, NL802154_ATTR_PAGE, page) ||
+		    nla_put_u8(msg, NL802154_ATTR_CHANNEL, channel))) {
+		nlmsg_free(msg);
+		msg = NULL;
+	}
+	return phyctl_send(pc, msg, NULL, "set channel");
+}
@@ -0,0 +1,58 @@
+/*
+ * nl802154 PHY and MAC control of wpan-ping and wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_COMMON_PHYCTL_H
+#define __WPAN_COMMON_PHYCTL_H
+
+#include <stdint.h>
+
+#define PHYCTL_MAX_TX_POWERS 32
+#define PHYCTL_MAX_PAGES 32
+
+/* CSMA/CA and retry settings of one interface, as in "iwpan dev info" */
+struct mac_params {
+	int min_be;
+	int max_be;
+	int csma_backoffs;
+	int frame_retries;
+};
+
+/* Ranges and levels the PHY advertises in NL802154_ATTR_WPAN_PHY_CAPS */
+struct phy_caps {
+	struct mac_params min;
+	struct mac_params max;
+	int32_t tx_powers[PHYCTL_MAX_TX_POWERS]; /* mBm, as reported */
+	int num_tx_powers;
+	uint32_t channels[PHYCTL_MAX_PAGES]; /* bit n set if channel n is supported */
+};
+
+struct phyctl;
+
+struct phyctl *phyctl_open(const char *ifname);
+void phyctl_close(struct phyctl *pc);
+
+int phyctl_get_caps(struct phyctl *pc, struct phy_caps *caps);
+int phyctl_get_mac(struct phyctl *pc, struct mac_params *mac);
+int phyctl_get_tx_power(struct phyctl *pc, int32_t *mbm);
+int phyctl_get_channel(struct phyctl *pc, uint8_t *page, uint8_t *channel);
+
+/* The MAC settings are only accepted while the interface is down */
+int phyctl_set_mac(struct phyctl *pc, const struct mac_params *mac);
+int phyctl_set_tx_power(struct phyctl *pc, int32_t mbm);
+/* Retunes the phy, every interface on it follows */
+int phyctl_set_channel(struct phyctl *pc, uint8_t page, uint8_t channel);
+
+#endif /* __WPAN_COMMON_PHYCTL_H */
@@ -11,6 +11,7 @@
 #include "nl802154.h"
 #include "nl_extras.h"
 #include "iwpan.h"
+#include "freq.h"
 
 static void print_minmax_handler(int min, int max)
 {
@@ -25,119 +26,24 @@ static void print_minmax_handler(int min, int max)
 
 static void print_freq_handler(int channel_page, int channel)
 {
-	float freq = 0;
+	float freq = ieee802154_channel_freq(channel_page, channel);
 
 	switch (channel_page) {
 	case 0:
-		if (channel == 0) {
-			freq = 868.3;
-			printf("%5.1f", freq);
-			break;
-		} else if (channel > 0 && channel < 11) {
-			freq = 906 + 2 * (channel - 1);
-		} else {
-			freq = 2405 + 5 * (channel - 11);
-		}
-		printf("%5.0f", freq);
-		break;
 	case 1:
-		if (channel == 0) {
-			freq = 868.3;
-			printf("%5.1f", freq);
-			break;
-		} else if (channel >= 1 && channel <= 10) {
-			freq = 906 + 2 * (channel - 1);
-		}
-		printf("%5.0f", freq);
-		break;
 	case 2:
-		if (channel == 0) {
-			freq = 868.3;
-			printf("%5.1f", freq);
-			break;
-		} else if (channel >= 1 && channel <= 10) {
-			freq = 906 + 2 * (channel - 1);
-		}
-		printf("%5.0f", freq);
+		printf(channel == 0 ? "%5.1f" : "%5.0f", freq);
 		break;
 	case 3:
-		if (channel >= 0 && channel <= 12) {
-			freq = 2412 + 5 * channel;
-		} else if (channel == 13) {
-			freq = 2484;
-		}
 		printf("%4.0f", freq);
 		break;
 	case 4:
-		switch (channel) {
-		case 0:
-			freq = 499.2;
-			break;
-		case 1:
-			freq = 3494.4;
-			break;
-		case 2:
-			freq = 3993.6;
-			break;
-		case 3:
-			freq = 4492.8;
-			break;
-		case 4:
-			freq = 3993.6;
-			break;
-		case 5:
-			freq = 6489.6;
-			break;
-		case 6:
-			freq = 6988.8;
-			break;
-		case 7:
-			freq = 6489.6;
-			break;
-		case 8:
-			freq = 7488.0;
-			break;
-		case 9:
-			freq = 7987.2;
-			break;
-		case 10:
-			freq = 8486.4;
-			break;
-		case 11:
-			freq = 7987.2;
-			break;
-		case 12:
-			freq = 8985.6;
-			break;
-		case 13:
-			freq = 9484.8;
-			break;
-		case 14:
-			freq = 9984.0;
-			break;
-		case 15:
-			freq = 9484.8;
-			break;
-		}
 		printf("%6.1f", freq);
 		break;
 	case 5:
-		if (channel >= 0 && channel <= 3) {
-			freq = 780 + 2 * channel;
-		} else if (channel >= 4 && channel <= 7) {
-			freq = 780 + 2 * (channel - 4);
-		}
 		printf("%3.0f", freq);
 		break;
 	case 6:
-		if (channel >= 0 && channel <= 7) {
-			freq = 951.2 + 0.6 * channel;
-		} else if (channel >= 8 && channel <= 9) {
-			freq = 954.4 + 0.2 * (channel - 8);
-		} else if (channel >= 10  && channel <= 21) {
-			freq = 951.1 + 0.4 * (channel - 10);
-		}
-
 		printf("%5.1f", freq);
 		break;
 	default:
@@ -0,0 +1,252 @@
+/*
+ * pcapng capture of the frames wpan-ping sends and receives
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <endian.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "pcapng-block.h"
+
+#define CAPTURE_IDLE_NS 10000000L
+
+/* Frame control: data frame, PAN ID compression, 2006 frame version */
+#define MAC_FC_DATA 0x0001
+#define MAC_FC_PANID_COMP 0x0040
+#define MAC_FC_DST_SHIFT 10
+#define MAC_FC_VERSION_2006 0x1000
+#define MAC_FC_SRC_SHIFT 14
+#define MAC_MAX_HEADER 23
+
+#define MAC_MAX_PAYLOAD 2047
+
+#define EPB_HEADER_LEN 28
+#define EPB_MAX_BLOCK (EPB_HEADER_LEN + MAC_MAX_HEADER + MAC_MAX_PAYLOAD + 32)
+
+/*
+ * Single producer, single consumer byte ring of finished pcapng blocks, the
+ * same scheme as the record stream. The probe loop only builds a block and
+ * copies it in, the writer thread does the file I/O.
+ */
+struct capture {
+	FILE *f;
+	pthread_t writer;
+	struct sockaddr_ieee802154 local;
+	unsigned char *ring;
+	unsigned long head;
+	unsigned long tail;
+	unsigned long frames;
+	unsigned long dropped;
+	uint8_t dsn;
+	bool stop;
+};
+
+static size_t pad4(size_t len)
+{
+	return (len + 3) & ~(size_t)3;
+}
+
+static void *capture_writer(void *arg)
+{
+	struct capture *c = arg;
+	struct timespec idle = { 0, CAPTURE_IDLE_NS };
+	unsigned long head, tail, off, chunk;
+	bool stop;
+
+	while (1) {
+		stop = __atomic_load_n(&c->stop, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE);
+		tail = c->tail;
+
+		if (head == tail) {
+			if (stop)
+				break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		/* At most two writes, the second one after the wrap around */
+		while (tail != head) {
+			off = tail & (CAPTURE_RING_SIZE - 1);
+			chunk = head - tail;
+			if (chunk > CAPTURE_RING_SIZE - off)
+				chunk = CAPTURE_RING_SIZE - off;
+			fwrite(c->ring + off, chunk, 1, c->f);
+			tail += chunk;
+		}
+		__atomic_store_n(&c->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+struct capture *capture_open(const char *path, const char *ifname,
+			     const struct sockaddr_ieee802154 *local)
+{
+	unsigned char block[PCAPNG_HEADERS_MAX];
+	struct capture *c;
+	size_t len;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	c->ring = malloc(CAPTURE_RING_SIZE);
+	if (!c->ring)
+		goto err_free;
+
+	c->f = fopen(path, "wb");
+	if (!c->f)
+		goto err_free_ring;
+	/* Timestamps in us, as the probe engine takes them */
+	len = write_headers(block, "wpan-ping", ifname,
+			    LINKTYPE_IEEE802_15_4_NOFCS, 6);
+	if (fwrite(block, len, 1, c->f) != 1)
+		goto err_close;
+	c->local = *local;
+
+	if (pthread_create(&c->writer, NULL, capture_writer, c))
+		goto err_close;
+
+	return c;
+
+err_close:
+	fclose(c->f);
+err_free_ring:
+	free(c->ring);
+err_free:
+	free(c);
+	return NULL;
+}
+
+/* Addresses go on air little endian, extended ones are kept big endian */
+static unsigned char *put_mac_addr(unsigned char *p,
+				   const struct ieee802154_addr_sa *sa)
+{
+	int i;
+
+	if (sa->addr_type != IEEE802154_ADDR_LONG)
+		return put_u16(p, htole16(sa->short_addr));
+
+	for (i = 0; i < IEEE802154_ADDR_LEN; i++)
+		*p++ = sa->hwaddr[IEEE802154_ADDR_LEN - 1 - i];
+	return p;
+}
+
+/*
+ * The socket only sees payloads, so the MAC header is rebuilt from the
+ * addresses. The sequence number is the capture's own, the one the kernel
+ * used is not known here.
+ */
+static size_t build_mac_header(unsigned char *p, uint8_t dsn,
+			       const struct ieee802154_addr_sa *src,
+			       const struct ieee802154_addr_sa *dst)
+{
+	unsigned char *start = p;
+	uint16_t fc = MAC_FC_DATA | MAC_FC_VERSION_2006;
+	bool compress = src->pan_id == dst->pan_id;
+
+	if (compress)
+		fc |= MAC_FC_PANID_COMP;
+	fc |= (dst->addr_type == IEEE802154_ADDR_LONG ? 3 : 2) << MAC_FC_DST_SHIFT;
+	fc |= (src->addr_type == IEEE802154_ADDR_LONG ? 3 : 2) << MAC_FC_SRC_SHIFT;
+
+	p = put_u16(p, htole16(fc));
+	*p++ = dsn;
+	p = put_u16(p, htole16(dst->pan_id));
+	p = put_mac_addr(p, dst);
+	if (!compress)
+		p = put_u16(p, htole16(src->pan_id));
+	p = put_mac_addr(p, src);
+
+	return p - start;
+}
+
+void capture_frame(struct capture *c, uint64_t ts_us,
+		   const void *payload, size_t len,
+		   const struct ieee802154_addr_sa *peer, bool inbound)
+{
+	unsigned char block[EPB_MAX_BLOCK], *p, *data;
+	uint32_t flags = inbound ? PCAPNG_EPB_INBOUND : PCAPNG_EPB_OUTBOUND;
+	unsigned long head, off, chunk;
+	size_t hdr, blen;
+
+	if (!c)
+		return;
+	if (len > MAC_MAX_PAYLOAD)
+		len = MAC_MAX_PAYLOAD;
+
+	data = block + EPB_HEADER_LEN;
+	if (inbound)
+		hdr = build_mac_header(data, c->dsn++, peer, &c->local.addr);
+	else
+		hdr = build_mac_header(data, c->dsn++, &c->local.addr, peer);
+	memcpy(data + hdr, payload, len);
+	memset(data + hdr + len, 0, pad4(hdr + len) - hdr - len);
+
+	p = put_u32(block, PCAPNG_EPB);
+	p = put_u32(p, 0);
+	p = put_u32(p, 0); /* interface */
+	p = put_u32(p, ts_us >> 32);
+	p = put_u32(p, ts_us & 0xffffffff);
+	p = put_u32(p, hdr + len);
+	p = put_u32(p, hdr + len);
+	p = data + pad4(hdr + len);
+	p = put_option(p, PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+	p = put_option(p, PCAPNG_OPT_END, NULL, 0);
+	blen = p - block + 4;
+	put_u32(p, blen);
+	put_u32(block + 4, blen);
+
+	head = c->head;
+	if (head - __atomic_load_n(&c->tail, __ATOMIC_ACQUIRE) + blen > CAPTURE_RING_SIZE) {
+		c->dropped++;
+		return;
+	}
+
+	off = head & (CAPTURE_RING_SIZE - 1);
+	chunk = blen < CAPTURE_RING_SIZE - off ? blen : CAPTURE_RING_SIZE - off;
+	memcpy(c->ring + off, block, chunk);
+	memcpy(c->ring, block + chunk, blen - chunk);
+	c->frames++;
+	__atomic_store_n(&c->head, head + blen, __ATOMIC_RELEASE);
+}
+
+void capture_close(struct capture *c)
+{
+	if (!c)
+		return;
+
+	__atomic_store_n(&c->stop, true, __ATOMIC_RELEASE);
+	pthread_join(c->writer, NULL);
+
+	if (fclose(c->f))
+		perror("capture");
+	if (c->dropped)
+		fprintf(stderr, "capture: %lu frames written, %lu dropped (ring full)\n",
+			c->frames, c->dropped);
+
+	free(c->ring);
+	free(c);
+}
@@ -0,0 +1,43 @@
+/*
+ * pcapng capture of the frames wpan-ping sends and receives
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_CAPTURE_H
+#define __WPAN_PING_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "transport.h"
+
+/* Must be a power of two, holds a few hundred full size frames */
+#define CAPTURE_RING_SIZE (1 << 20)
+
+struct capture;
+
+/* The local address is the source of sent and the destination of received frames */
+struct capture *capture_open(const char *path, const char *ifname,
+			     const struct sockaddr_ieee802154 *local);
+/*
+ * Queues one frame stamped ts_us, wall clock us. The payload gets a MAC
+ * header built from the addresses.
+ */
+void capture_frame(struct capture *c, uint64_t ts_us,
+		   const void *payload, size_t len,
+		   const struct ieee802154_addr_sa *peer, bool inbound);
+void capture_close(struct capture *c);
+
+#endif /* __WPAN_PING_CAPTURE_H */
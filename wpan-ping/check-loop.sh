@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Seeded runs over the loop transport. The same seed drops the same probes,
+# so the summaries must not change. Run by make check from the build tree.
+
+ping=./wpan-ping
+ret=0
+
+# expected summary line, then the wpan-ping options
+check()
+{
+	expect="$1"
+	shift
+	out=$($ping "$@" 2>&1)
+	if ! printf '%s\n' "$out" | grep -qxF "$expect"; then
+		echo "FAIL: wpan-ping $*"
+		echo "expected: $expect"
+		printf '%s\n' "$out"
+		ret=1
+	fi
+}
+
+check "200 packets transmitted, 175 received, 12% packet loss" \
+	-T loop:loss=10,seed=3 -a 0x0001 -c 200 -q
+# The window engine draws the same impairments in the same order
+check "200 packets transmitted, 175 received, 12% packet loss" \
+	-T loop:loss=10,seed=3 -a 0x0001 -c 200 -q -u -N 8
+
+exit $ret
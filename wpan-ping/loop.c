@@ -0,0 +1,405 @@
+/*
+ * UNIX datagram loopback transport with injected delay, loss and reordering
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "transport.h"
+#include "owd.h"
+
+#define LOOP_MTU 127
+#define LOOP_MAX_FRAME 2047
+/* Frames held back by the reflector, arrivals beyond that are tail dropped */
+#define LOOP_QUEUE 1024
+/* Emulated servers answering a broadcast, from 0x0002 upwards */
+#define LOOP_FIRST_NODE 0x0002
+#define LOOP_MAX_NODES 256
+#define LOOP_BROADCAST 0xffff
+
+/*
+ * The engine's end of a socketpair is t->fd, the other end belongs to a
+ * reflector thread which echoes every frame after its injected delay, like a
+ * wpan-ping server one hop away. The header travels with each frame: the
+ * destination on the way out is the source of the echo on the way back.
+ */
+struct loop_hdr {
+	struct ieee802154_addr_sa addr;
+	uint32_t delay_us;
+	bool lost; /* dropped by the reflector */
+};
+
+struct loop_slot {
+	uint64_t due_us;
+	uint64_t order;
+	size_t len; /* 0 for a free slot */
+	unsigned char data[sizeof(struct loop_hdr) + LOOP_MAX_FRAME];
+};
+
+struct loop {
+	int peer;
+	pthread_t reflector;
+	struct sockaddr_ieee802154 local;
+	struct loop_slot *queue;
+	uint64_t arrivals;
+	unsigned long overflows;
+	/* Impairments, only touched by the sending thread */
+	unsigned int delay_us;
+	unsigned int jitter_us;
+	float loss;
+	float reorder;
+	unsigned int nodes;
+	uint64_t rng;
+};
+
+static uint64_t loop_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* xorshift64*, the same seed gives the same sequence of impairments */
+static uint64_t loop_rand(struct loop *lp)
+{
+	lp->rng ^= lp->rng >> 12;
+	lp->rng ^= lp->rng << 25;
+	lp->rng ^= lp->rng >> 27;
+	return lp->rng * 0x2545f4914f6cdd1dULL;
+}
+
+/* Uniform in [0, 100) to compare against percentages */
+static float loop_percent(struct loop *lp)
+{
+	return (loop_rand(lp) >> 40) * (100.0f / (1 << 24));
+}
+
+static struct loop_slot *loop_next(struct loop *lp)
+{
+	struct loop_slot *next = NULL, *slot;
+	unsigned int i;
+
+	for (i = 0; i < LOOP_QUEUE; i++) {
+		slot = &lp->queue[i];
+		if (!slot->len)
+			continue;
+		if (!next || slot->due_us < next->due_us ||
+		    (slot->due_us == next->due_us && slot->order < next->order))
+			next = slot;
+	}
+
+	return next;
+}
+
+/* Queue one frame from the engine, false once the engine closed its end */
+static bool loop_receive(struct loop *lp)
+{
+	unsigned char scratch[sizeof(struct loop_hdr) + LOOP_MAX_FRAME];
+	struct loop_slot *slot = NULL;
+	struct loop_hdr *hdr;
+	unsigned int i;
+	ssize_t len;
+
+	for (i = 0; i < LOOP_QUEUE && !slot; i++) {
+		if (!lp->queue[i].len)
+			slot = &lp->queue[i];
+	}
+
+	len = recv(lp->peer, slot ? slot->data : scratch, sizeof(scratch),
+		   MSG_DONTWAIT);
+	if (len < 0)
+		return errno == EAGAIN || errno == EINTR;
+	if (!len)
+		return false;
+	if (!slot) {
+		lp->overflows++;
+		return true;
+	}
+	if ((size_t)len < sizeof(*hdr))
+		return true;
+
+	hdr = (struct loop_hdr *)slot->data;
+	if (hdr->lost)
+		return true;
+	slot->due_us = loop_now_us() + hdr->delay_us;
+	slot->order = lp->arrivals++;
+	slot->len = len;
+	return true;
+}
+
+static void *loop_reflector(void *arg)
+{
+	struct loop *lp = arg;
+	struct pollfd pfd = { .fd = lp->peer };
+	struct loop_slot *next;
+	uint64_t now;
+	int timeout;
+
+	for (;;) {
+		next = loop_next(lp);
+		now = loop_now_us();
+		timeout = -1;
+		pfd.events = POLLIN;
+
+		if (next && next->due_us <= now) {
+			owd_stamp(next->data + sizeof(struct loop_hdr),
+				  next->len - sizeof(struct loop_hdr), now, now);
+			/* Never block on a full engine socket, keep receiving */
+			if (send(lp->peer, next->data, next->len, MSG_DONTWAIT) >= 0 ||
+			    errno != EAGAIN) {
+				next->len = 0;
+				continue;
+			}
+			pfd.events |= POLLOUT;
+		} else if (next) {
+			timeout = (next->due_us - now + 999) / 1000;
+		}
+
+		if (poll(&pfd, 1, timeout) <= 0 || !(pfd.revents & POLLIN))
+			continue;
+		if (!loop_receive(lp))
+			break;
+	}
+
+	return NULL;
+}
+
+/* delay=ms,jitter=ms,loss=%,reorder=%,seed=n,mtu=bytes,nodes=n */
+static int loop_init(struct transport *t, const char *opts)
+{
+	struct loop *lp;
+	char *copy, *tok, *save = NULL;
+	unsigned long long seed = 1;
+	float delay = 0, jitter = 0;
+	int ret = 0;
+
+	lp = calloc(1, sizeof(*lp));
+	if (!lp)
+		return -ENOMEM;
+	t->priv = lp;
+	t->mtu = LOOP_MTU;
+	lp->nodes = 1;
+
+	copy = strdup(opts ? opts : "");
+	if (!copy)
+		return -ENOMEM;
+
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (sscanf(tok, "delay=%f", &delay) == 1 ||
+		    sscanf(tok, "jitter=%f", &jitter) == 1 ||
+		    sscanf(tok, "loss=%f", &lp->loss) == 1 ||
+		    sscanf(tok, "reorder=%f", &lp->reorder) == 1 ||
+		    sscanf(tok, "seed=%llu", &seed) == 1 ||
+		    sscanf(tok, "mtu=%u", &t->mtu) == 1 ||
+		    sscanf(tok, "nodes=%u", &lp->nodes) == 1)
+			continue;
+		ret = -EINVAL;
+	}
+	free(copy);
+
+	if (delay < 0 || jitter < 0 || lp->loss < 0 || lp->loss > 100 ||
+	    lp->reorder < 0 || lp->reorder > 100 ||
+	    t->mtu < LOOP_MTU || t->mtu > LOOP_MAX_FRAME ||
+	    !lp->nodes || lp->nodes > LOOP_MAX_NODES)
+		ret = -EINVAL;
+
+	lp->delay_us = delay * 1000;
+	lp->jitter_us = jitter * 1000;
+	/* xorshift must never be seeded with zero */
+	lp->rng = seed ? seed : 1;
+	return ret;
+}
+
+static int loop_open(struct transport *t, const struct sockaddr_ieee802154 *src)
+{
+	struct loop *lp = t->priv;
+	int sv[2];
+
+	lp->local = *src;
+	lp->queue = calloc(LOOP_QUEUE, sizeof(*lp->queue));
+	if (!lp->queue)
+		return -1;
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv)) {
+		perror("socketpair");
+		goto err;
+	}
+	t->fd = sv[0];
+	lp->peer = sv[1];
+
+	errno = pthread_create(&lp->reflector, NULL, loop_reflector, lp);
+	if (errno) {
+		perror("pthread_create");
+		close(sv[0]);
+		close(sv[1]);
+		goto err;
+	}
+
+	return 0;
+err:
+	free(lp->queue);
+	lp->queue = NULL;
+	return -1;
+}
+
+/*
+ * Every random decision is drawn here, always three per frame and in send
+ * order, so a seed replays the same impairments for the same probe sequence.
+ */
+static void loop_header(struct loop *lp, struct loop_hdr *hdr,
+			const struct ieee802154_addr_sa *addr)
+{
+	bool late;
+	uint32_t jitter;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->lost = loop_percent(lp) < lp->loss;
+	late = loop_percent(lp) < lp->reorder;
+	jitter = loop_rand(lp) % (lp->jitter_us + 1);
+
+	/* A late frame is overtaken by everything sent within one delay */
+	hdr->addr = *addr;
+	hdr->delay_us = lp->delay_us + jitter;
+	if (late)
+		hdr->delay_us += lp->delay_us + lp->jitter_us;
+}
+
+static int loop_queue(struct transport *t, const void *buf, size_t len,
+		      const struct ieee802154_addr_sa *addr)
+{
+	struct loop_hdr hdr;
+	struct iovec iov[2];
+
+	loop_header(t->priv, &hdr, addr);
+	if (hdr.lost)
+		return 0;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *)buf;
+	iov[1].iov_len = len;
+	return writev(t->fd, iov, 2) < 0 ? -1 : 0;
+}
+
+static ssize_t loop_send(struct transport *t, const void *buf, size_t len,
+			 const struct sockaddr_ieee802154 *dst)
+{
+	struct loop *lp = t->priv;
+	struct ieee802154_addr_sa node;
+	unsigned int i;
+
+	if (len > t->mtu) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	if (dst->addr.addr_type != IEEE802154_ADDR_SHORT ||
+	    dst->addr.short_addr != LOOP_BROADCAST)
+		return loop_queue(t, buf, len, &dst->addr) ? -1 : (ssize_t)len;
+
+	/* Each node answers a broadcast with its own impairments */
+	node = dst->addr;
+	for (i = 0; i < lp->nodes; i++) {
+		node.short_addr = LOOP_FIRST_NODE + i;
+		if (loop_queue(t, buf, len, &node))
+			return -1;
+	}
+	return len;
+}
+
+static ssize_t loop_recv(struct transport *t, void *buf, size_t len, int flags,
+			 struct sockaddr_ieee802154 *src)
+{
+	struct loop_hdr hdr;
+	struct iovec iov[2] = {
+		{ .iov_base = &hdr, .iov_len = sizeof(hdr) },
+		{ .iov_base = buf, .iov_len = len },
+	};
+	struct msghdr msg = {
+		.msg_iov = iov,
+		.msg_iovlen = 2,
+	};
+	ssize_t ret;
+
+	ret = recvmsg(t->fd, &msg, flags);
+	if (ret < 0)
+		return ret;
+	if ((size_t)ret < sizeof(hdr)) {
+		errno = EIO;
+		return -1;
+	}
+
+	if (src) {
+		src->family = AF_IEEE802154;
+		src->addr = hdr.addr;
+	}
+	return ret - sizeof(hdr);
+}
+
+static int loop_addr(struct transport *t, struct sockaddr_ieee802154 *sa)
+{
+	struct loop *lp = t->priv;
+
+	*sa = lp->local;
+	return 0;
+}
+
+/* Frames sent by the io_uring engine, a lost one still goes to the reflector */
+static void loop_wrap(struct transport *t, void *hdr,
+		      const struct sockaddr_ieee802154 *dst)
+{
+	loop_header(t->priv, hdr, &dst->addr);
+}
+
+static void loop_close(struct transport *t)
+{
+	struct loop *lp = t->priv;
+
+	/* A zero length datagram stops the reflector */
+	send(t->fd, NULL, 0, 0);
+	pthread_join(lp->reflector, NULL);
+	if (lp->overflows)
+		fprintf(stderr, "loop: %lu frames dropped on a full queue\n",
+			lp->overflows);
+
+	close(t->fd);
+	close(lp->peer);
+	free(lp->queue);
+	lp->queue = NULL;
+}
+
+const struct transport_ops loop_transport = {
+	.name = "loop",
+	.hdr_len = sizeof(struct loop_hdr),
+	.init = loop_init,
+	.open = loop_open,
+	.send = loop_send,
+	.recv = loop_recv,
+	.addr = loop_addr,
+	.close = loop_close,
+	.wrap = loop_wrap,
+};
@@ -0,0 +1,164 @@
+/*
+ * One way delay estimation from server timestamped echoes
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#include "owd.h"
+
+static void put_be64(unsigned char *p, uint64_t v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = v >> (56 - 8 * i);
+}
+
+static uint64_t get_be64(const unsigned char *p)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v = (v << 8) | p[i];
+	return v;
+}
+
+/* Turn a probe into a timestamp request, the server fills in the rest */
+void owd_request(unsigned char *buf, size_t len)
+{
+	if (len < OWD_PAYLOAD_LEN)
+		return;
+
+	buf[OWD_MAGIC_OFFSET] = OWD_MAGIC;
+	memset(buf + OWD_RX_OFFSET, 0, OWD_PAYLOAD_LEN - OWD_RX_OFFSET);
+}
+
+bool owd_requested(const unsigned char *buf, size_t len)
+{
+	return len >= OWD_PAYLOAD_LEN && buf[OWD_MAGIC_OFFSET] == OWD_MAGIC;
+}
+
+void owd_stamp(unsigned char *buf, size_t len, uint64_t rx_us, uint64_t tx_us)
+{
+	if (!owd_requested(buf, len))
+		return;
+
+	put_be64(buf + OWD_RX_OFFSET, rx_us);
+	put_be64(buf + OWD_TX_OFFSET, tx_us);
+}
+
+/* Servers stamp with the monotonic clock, its epoch does not matter */
+uint64_t owd_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void owd_init(struct owd_estimator *est)
+{
+	memset(est, 0, sizeof(*est));
+}
+
+static void owd_dir_add(struct owd_dir *d, float v)
+{
+	if (!d->count || v < d->min)
+		d->min = v;
+	if (!d->count || v > d->max)
+		d->max = v;
+	d->sum += v;
+	d->count++;
+}
+
+/*
+ * The offset of a single exchange, ((t2 - t1) + (t3 - t4)) / 2, is only
+ * right if both directions took equally long. As in NTP, the sample with the
+ * least round trip delay among the last few is the least queued one and
+ * trusted most. Those samples are fitted over time, the slope is the drift
+ * and the fit gives the offset to split each probe's rtt into forward and
+ * return delay.
+ */
+bool owd_sample(struct owd_estimator *est, const unsigned char *buf, size_t len,
+		uint64_t t1, uint64_t t4, struct owd_result *res)
+{
+	uint64_t t2, t3;
+	int64_t offset, delay;
+	unsigned int i, n, best;
+	double x, y, den, slope, icept;
+
+	if (!owd_requested(buf, len))
+		return false;
+
+	t2 = get_be64(buf + OWD_RX_OFFSET);
+	t3 = get_be64(buf + OWD_TX_OFFSET);
+	if (!t2 || t3 < t2)
+		return false;
+
+	offset = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+	delay = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+
+	i = est->samples++ % OWD_FILTER;
+	est->filter[i].offset = offset;
+	est->filter[i].delay = delay;
+
+	n = est->samples < OWD_FILTER ? est->samples : OWD_FILTER;
+	for (best = 0, i = 1; i < n; i++) {
+		if (est->filter[i].delay < est->filter[best].delay)
+			best = i;
+	}
+
+	if (!est->fits) {
+		est->t0 = t1;
+		est->offset0 = offset;
+	}
+	x = (double)(t1 - est->t0) / 1000000;
+
+	/* Each sample enters the fit once, when it is the best of the filter */
+	if (best == (est->samples - 1) % OWD_FILTER) {
+		y = offset - est->offset0;
+		est->sx += x;
+		est->sy += y;
+		est->sxx += x * x;
+		est->sxy += x * y;
+		est->fits++;
+	}
+
+	den = est->fits * est->sxx - est->sx * est->sx;
+	if (est->fits >= 2 && den > 0) {
+		/* us of offset per s of client time are ppm */
+		slope = (est->fits * est->sxy - est->sx * est->sy) / den;
+		icept = (est->sy - slope * est->sx) / est->fits;
+		est->drift = slope;
+		est->offset = est->offset0 + (int64_t)(icept + slope * x);
+	} else {
+		est->offset = est->filter[best].offset;
+	}
+
+	res->fwd = ((int64_t)(t2 - t1) - est->offset) / 1000.0f;
+	res->ret = ((int64_t)(t4 - t3) + est->offset) / 1000.0f;
+	res->proc = (t3 - t2) / 1000.0f;
+
+	owd_dir_add(&est->fwd, res->fwd);
+	owd_dir_add(&est->ret, res->ret);
+	owd_dir_add(&est->proc, res->proc);
+	return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * One way delay estimation from server timestamped echoes
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_OWD_H
+#define __WPAN_PING_OWD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A timestamp probe carries a marker byte after the 32 bit sequence and room
+ * for two big endian 64 bit server timestamps in us, receive and transmit.
+ * The byte in between holds the marker of the wide sequence.
+ */
+#define OWD_MAGIC_OFFSET 6
+#define OWD_MAGIC 0x54
+#define OWD_RX_OFFSET 8
+#define OWD_TX_OFFSET 16
+#define OWD_PAYLOAD_LEN 24
+
+/* Samples of the NTP style clock filter, the one with least delay wins */
+#define OWD_FILTER 8
+
+struct owd_dir {
+	unsigned int count;
+	float min;
+	float max;
+	double sum;
+};
+
+struct owd_estimator {
+	struct {
+		int64_t offset;
+		int64_t delay;
+	} filter[OWD_FILTER];
+	unsigned int samples;
+	/* Least squares of the filtered offsets over client time for drift */
+	uint64_t t0;
+	int64_t offset0;
+	double sx, sy, sxx, sxy;
+	unsigned int fits;
+	int64_t offset; /* server minus client clock in us */
+	double drift; /* server clock speed relative to the client, in ppm */
+	struct owd_dir fwd;
+	struct owd_dir ret;
+	struct owd_dir proc;
+};
+
+/* One way delays of one probe in ms */
+struct owd_result {
+	float fwd;
+	float ret;
+	float proc;
+};
+
+void owd_request(unsigned char *buf, size_t len);
+bool owd_requested(const unsigned char *buf, size_t len);
+void owd_stamp(unsigned char *buf, size_t len, uint64_t rx_us, uint64_t tx_us);
+uint64_t owd_now_us(void);
+
+void owd_init(struct owd_estimator *est);
+/* t1 client send, t2 server receive, t3 server send, t4 client receive */
+bool owd_sample(struct owd_estimator *est, const unsigned char *buf, size_t len,
+		uint64_t t1, uint64_t t4, struct owd_result *res);
+
+#endif /* __WPAN_PING_OWD_H */
@@ -0,0 +1,206 @@
+/*
+ * Per source accounting of the wpan-ping server
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "peers.h"
+
+#define PEER_TABLE_MIN 64
+
+static struct peer *peer_slot(struct peer *slots, unsigned int size, uint64_t key,
+			      int type, uint16_t pan)
+{
+	unsigned int i = addr_hash(key, type, pan, size);
+
+	/* Linear probing, the table never fills up */
+	while (slots[i].used &&
+	       (slots[i].key != key || slots[i].addr.addr_type != type ||
+		slots[i].addr.pan_id != pan))
+		i = (i + 1) & (size - 1);
+	return &slots[i];
+}
+
+int peer_table_init(struct peer_table *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->slots = calloc(PEER_TABLE_MIN, sizeof(*t->slots));
+	if (!t->slots)
+		return -ENOMEM;
+	t->size = PEER_TABLE_MIN;
+	return 0;
+}
+
+void peer_table_free(struct peer_table *t)
+{
+	free(t->slots);
+	t->slots = NULL;
+}
+
+static int peer_table_grow(struct peer_table *t)
+{
+	unsigned int i, size = t->size * 2;
+	struct peer *slots, *p;
+
+	slots = calloc(size, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+
+	for (i = 0; i < t->size; i++) {
+		if (!t->slots[i].used)
+			continue;
+		p = peer_slot(slots, size, t->slots[i].key, t->slots[i].addr.addr_type,
+			      t->slots[i].addr.pan_id);
+		*p = t->slots[i];
+	}
+
+	free(t->slots);
+	t->slots = slots;
+	t->size = size;
+	return 0;
+}
+
+static struct peer *peer_lookup(struct peer_table *t,
+				const struct ieee802154_addr_sa *sa)
+{
+	uint64_t key = addr_key(sa);
+	struct peer *p;
+
+	p = peer_slot(t->slots, t->size, key, sa->addr_type, sa->pan_id);
+	if (p->used)
+		return p;
+
+	if (t->used >= PEER_MAX)
+		return NULL;
+	/* Keep the load below 3/4 so probe chains stay short */
+	if ((t->used + 1) * 4 > t->size * 3) {
+		if (peer_table_grow(t))
+			return NULL;
+		p = peer_slot(t->slots, t->size, key, sa->addr_type, sa->pan_id);
+	}
+
+	p->used = true;
+	p->key = key;
+	p->addr = *sa;
+	t->used++;
+	return p;
+}
+
+/*
+ * Sequence numbers are compared in serial number arithmetic of their width,
+ * so 16 bit sequences wrap cleanly. A sequence ahead of the highest one
+ * opens a gap for every skipped number, a late arrival inside the window
+ * closes one again. A small sequence far behind the window is taken for a
+ * client that started a new run.
+ */
+static void peer_sequence(struct peer *p, uint32_t seq, unsigned int seq_bits)
+{
+	uint32_t mask = seq_bits < 32 ? (1U << seq_bits) - 1 : 0xffffffff;
+	uint32_t ahead, behind;
+	uint64_t bit;
+
+	if (!p->seen_seq) {
+		p->seen_seq = true;
+		p->highest = seq;
+		p->window = 1;
+		return;
+	}
+
+	ahead = (seq - p->highest) & mask;
+	behind = (p->highest - seq) & mask;
+
+	if (!ahead) {
+		p->duplicates++;
+	} else if (ahead <= mask / 2) {
+		p->gaps += ahead - 1;
+		p->window = ahead < PEER_WINDOW ? (p->window << ahead) | 1 : 1;
+		p->highest = seq;
+	} else if (behind < PEER_WINDOW) {
+		bit = 1ULL << behind;
+		if (p->window & bit) {
+			p->duplicates++;
+			return;
+		}
+		p->window |= bit;
+		p->reordered++;
+		if (p->gaps)
+			p->gaps--;
+	} else if (seq < PEER_WINDOW) {
+		p->restarts++;
+		p->highest = seq;
+		p->window = 1;
+	} else {
+		p->stale++;
+	}
+}
+
+void peer_account(struct peer_table *t, const struct ieee802154_addr_sa *sa,
+		  uint32_t seq, unsigned int seq_bits, unsigned int len,
+		  uint64_t now_us)
+{
+	struct peer *p;
+
+	p = peer_lookup(t, sa);
+	if (!p) {
+		t->untracked++;
+		return;
+	}
+
+	if (!p->frames)
+		p->first_us = now_us;
+	p->last_us = now_us;
+	p->frames++;
+	p->bytes += len;
+	peer_sequence(p, seq, seq_bits);
+}
+
+static int peer_cmp(const void *a, const void *b)
+{
+	const struct peer *pa = *(const struct peer * const *)a;
+	const struct peer *pb = *(const struct peer * const *)b;
+
+	if (pa->addr.addr_type != pb->addr.addr_type)
+		return pa->addr.addr_type < pb->addr.addr_type ? -1 : 1;
+	if (pa->addr.pan_id != pb->addr.pan_id)
+		return pa->addr.pan_id < pb->addr.pan_id ? -1 : 1;
+	if (pa->key == pb->key)
+		return 0;
+	return pa->key < pb->key ? -1 : 1;
+}
+
+struct peer **peer_table_list(const struct peer_table *t, unsigned int *num)
+{
+	struct peer **list;
+	unsigned int i, n = 0;
+
+	list = malloc((t->used ? t->used : 1) * sizeof(*list));
+	if (!list)
+		return NULL;
+
+	for (i = 0; i < t->size; i++) {
+		if (t->slots[i].used)
+			list[n++] = &t->slots[i];
+	}
+	qsort(list, n, sizeof(*list), peer_cmp);
+
+	*num = n;
+	return list;
+}
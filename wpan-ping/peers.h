@@ -0,0 +1,64 @@
+/*
+ * Per source accounting of the wpan-ping server
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_PEERS_H
+#define __WPAN_PING_PEERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "transport.h"
+
+/* Sequences within this distance behind the highest one are remembered */
+#define PEER_WINDOW 64
+/* Hard limit of tracked sources, frames from further ones are only counted */
+#define PEER_MAX 65536
+
+struct peer {
+	struct ieee802154_addr_sa addr;
+	uint64_t key;
+	bool used;
+	bool seen_seq;
+	uint32_t highest;
+	uint64_t window; /* bit n set: highest - n was received */
+	unsigned long frames;
+	unsigned long bytes;
+	unsigned long gaps; /* sequences skipped and not filled in later */
+	unsigned long duplicates;
+	unsigned long reordered;
+	unsigned long stale; /* too far behind the window to classify */
+	unsigned long restarts;
+	uint64_t first_us;
+	uint64_t last_us;
+};
+
+struct peer_table {
+	struct peer *slots;
+	unsigned int size; /* power of two */
+	unsigned int used;
+	unsigned long untracked;
+};
+
+int peer_table_init(struct peer_table *t);
+void peer_table_free(struct peer_table *t);
+/* seq_bits is 16 or 32, as the sequence field of the frame was wide */
+void peer_account(struct peer_table *t, const struct ieee802154_addr_sa *sa,
+		  uint32_t seq, unsigned int seq_bits, unsigned int len,
+		  uint64_t now_us);
+/* All peers in address order, the caller frees the array */
+struct peer **peer_table_list(const struct peer_table *t, unsigned int *num);
+
+#endif /* __WPAN_PING_PEERS_H */
@@ -0,0 +1,215 @@
+/*
+ * Per probe record stream of wpan-ping
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "record.h"
+#include "trace.h"
+
+/* Must be a power of two, 64k records are about 2.5 MB */
+#define RECORD_RING_SIZE 65536
+#define RECORD_IDLE_NS 10000000L
+
+/*
+ * Single producer, single consumer ring. The measurement loop only ever
+ * writes a slot and publishes the new head, all formatting and file I/O
+ * happens in the writer thread.
+ */
+struct recorder {
+	FILE *f;
+	enum record_format format;
+	struct trace_writer *trace;
+	pthread_t writer;
+	struct probe_record *ring;
+	unsigned long head;
+	unsigned long tail;
+	unsigned long dropped;
+	unsigned long written;
+	bool stop;
+};
+
+static const char *status_names[] = {
+	[RECORD_OK] = "ok",
+	[RECORD_TIMEOUT] = "timeout",
+	[RECORD_ERROR] = "error",
+};
+
+int record_parse_format(const char *name, enum record_format *format)
+{
+	if (!strcmp(name, "csv"))
+		*format = RECORD_CSV;
+	else if (!strcmp(name, "ndjson"))
+		*format = RECORD_NDJSON;
+	else if (!strcmp(name, "bin"))
+		*format = RECORD_BINARY;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+static void format_record_addr(char *buf, size_t len, const struct probe_record *r)
+{
+	if (r->extended)
+		snprintf(buf, len, "%016llx", (unsigned long long)r->addr);
+	else
+		snprintf(buf, len, "0x%04x", (unsigned int)r->addr);
+}
+
+static void write_record(struct recorder *rec, const struct probe_record *r)
+{
+	char addr[24];
+
+	switch (rec->format) {
+	case RECORD_CSV:
+		format_record_addr(addr, sizeof(addr), r);
+		fprintf(rec->f, "%u,%s,%llu,%llu,%u,%s\n", r->seq, addr,
+			(unsigned long long)r->tx_us, (unsigned long long)r->rx_us,
+			r->size, status_names[r->status]);
+		break;
+	case RECORD_NDJSON:
+		format_record_addr(addr, sizeof(addr), r);
+		fprintf(rec->f, "{\"seq\":%u,\"addr\":\"%s\",\"tx_us\":%llu,"
+			"\"rx_us\":%llu,\"size\":%u,\"status\":\"%s\"}\n", r->seq,
+			addr, (unsigned long long)r->tx_us,
+			(unsigned long long)r->rx_us, r->size,
+			status_names[r->status]);
+		break;
+	case RECORD_BINARY:
+		trace_writer_append(rec->trace, r);
+		break;
+	}
+	rec->written++;
+}
+
+static void *record_writer(void *arg)
+{
+	struct recorder *rec = arg;
+	struct timespec idle = { 0, RECORD_IDLE_NS };
+	unsigned long head, tail;
+	bool stop;
+
+	while (1) {
+		stop = __atomic_load_n(&rec->stop, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+		tail = rec->tail;
+
+		if (head == tail) {
+			if (stop)
+				break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		for (; tail != head; tail++)
+			write_record(rec, &rec->ring[tail & (RECORD_RING_SIZE - 1)]);
+		__atomic_store_n(&rec->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+struct recorder *record_open(const char *path, enum record_format format)
+{
+	struct recorder *rec;
+	struct timeval now;
+
+	rec = calloc(1, sizeof(*rec));
+	if (!rec)
+		return NULL;
+
+	rec->ring = malloc(RECORD_RING_SIZE * sizeof(*rec->ring));
+	if (!rec->ring)
+		goto err_free;
+
+	rec->f = fopen(path, format == RECORD_BINARY ? "wb" : "w");
+	if (!rec->f)
+		goto err_free_ring;
+
+	rec->format = format;
+	if (format == RECORD_CSV)
+		fprintf(rec->f, "seq,addr,tx_us,rx_us,size,status\n");
+	else if (format == RECORD_BINARY) {
+		gettimeofday(&now, NULL);
+		rec->trace = trace_writer_open(rec->f, (uint64_t)now.tv_sec * 1000000 +
+					       now.tv_usec);
+		if (!rec->trace)
+			goto err_close;
+	}
+
+	if (pthread_create(&rec->writer, NULL, record_writer, rec))
+		goto err_trace;
+
+	return rec;
+
+err_trace:
+	if (rec->trace)
+		trace_writer_close(rec->trace);
+err_close:
+	fclose(rec->f);
+err_free_ring:
+	free(rec->ring);
+err_free:
+	free(rec);
+	return NULL;
+}
+
+void record_push(struct recorder *rec, const struct probe_record *r)
+{
+	unsigned long head;
+
+	if (!rec)
+		return;
+
+	head = rec->head;
+	if (head - __atomic_load_n(&rec->tail, __ATOMIC_ACQUIRE) >= RECORD_RING_SIZE) {
+		rec->dropped++;
+		return;
+	}
+
+	rec->ring[head & (RECORD_RING_SIZE - 1)] = *r;
+	__atomic_store_n(&rec->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void record_close(struct recorder *rec)
+{
+	if (!rec)
+		return;
+
+	__atomic_store_n(&rec->stop, true, __ATOMIC_RELEASE);
+	pthread_join(rec->writer, NULL);
+
+	if (rec->trace && trace_writer_close(rec->trace))
+		fprintf(stderr, "record: failed to finish trace\n");
+	fclose(rec->f);
+	if (rec->dropped)
+		fprintf(stderr, "record: %lu records written, %lu dropped (ring full)\n",
+			rec->written, rec->dropped);
+
+	free(rec->ring);
+	free(rec);
+}
@@ -0,0 +1,53 @@
+/*
+ * Per probe record stream of wpan-ping
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_RECORD_H
+#define __WPAN_PING_RECORD_H
+
+#include <stdint.h>
+
+enum record_format {
+	RECORD_CSV,
+	RECORD_NDJSON,
+	RECORD_BINARY,
+};
+
+enum record_status {
+	RECORD_OK,
+	RECORD_TIMEOUT,
+	RECORD_ERROR, /* the probe could not be sent */
+};
+
+/* Fixed size record of one probe, timestamps in us since the epoch */
+struct probe_record {
+	uint64_t addr;
+	uint64_t tx_us;
+	uint64_t rx_us;
+	uint32_t seq;
+	uint16_t size;
+	uint8_t status;
+	uint8_t extended;
+};
+
+struct recorder;
+
+int record_parse_format(const char *name, enum record_format *format);
+struct recorder *record_open(const char *path, enum record_format format);
+/* Never blocks, the record is dropped and counted if the ring is full */
+void record_push(struct recorder *rec, const struct probe_record *r);
+void record_close(struct recorder *rec);
+
+#endif /* __WPAN_PING_RECORD_H */
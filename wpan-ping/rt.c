@@ -0,0 +1,151 @@
+/*
+ * Low jitter measurement setup of the wpan-ping client
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "rt.h"
+
+#define RT_FIFO_PRIO 50
+
+int rt_parse(const char *opts, struct rt_opts *rt)
+{
+	char *copy, *tok, *save = NULL;
+	int ret = 0;
+
+	memset(rt, 0, sizeof(*rt));
+	rt->enabled = true;
+	rt->cpu = -1;
+
+	copy = strdup(opts ? opts : "");
+	if (!copy)
+		return -ENOMEM;
+
+	for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		if (sscanf(tok, "cpu=%d", &rt->cpu) == 1 ||
+		    sscanf(tok, "fifo=%d", &rt->fifo_prio) == 1)
+			continue;
+		if (!strcmp(tok, "fifo"))
+			rt->fifo_prio = RT_FIFO_PRIO;
+		else if (!strcmp(tok, "busy"))
+			rt->busy = true;
+		else
+			ret = -EINVAL;
+	}
+	free(copy);
+
+	if (rt->cpu < -1 || rt->cpu >= CPU_SETSIZE || rt->fifo_prio < 0 ||
+	    (rt->fifo_prio && (rt->fifo_prio < sched_get_priority_min(SCHED_FIFO) ||
+			       rt->fifo_prio > sched_get_priority_max(SCHED_FIFO))))
+		ret = -EINVAL;
+
+	return ret;
+}
+
+static void rt_prefault_stack(void)
+{
+	volatile unsigned char stack[RT_STACK_PREFAULT];
+
+	memset((void *)stack, 0, sizeof(stack));
+}
+
+void rt_enter(const struct rt_opts *rt)
+{
+	struct sched_param param;
+	cpu_set_t set;
+	int cpu, locked;
+
+	cpu = rt->cpu >= 0 ? rt->cpu : sched_getcpu();
+	if (cpu < 0) {
+		perror("rt: sched_getcpu");
+	} else {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			perror("rt: sched_setaffinity");
+	}
+
+	if (rt->fifo_prio) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = rt->fifo_prio;
+		if (sched_setscheduler(0, SCHED_FIFO, &param))
+			perror("rt: sched_setscheduler");
+	}
+
+	/* Future mappings are locked too, so buffers allocated later are resident */
+	locked = !mlockall(MCL_CURRENT | MCL_FUTURE);
+	if (!locked)
+		perror("rt: mlockall");
+	rt_prefault_stack();
+
+	fprintf(stdout, "rt: cpu %i, %s%s, memory %s\n", cpu,
+		rt->fifo_prio ? "SCHED_FIFO" : "SCHED_OTHER",
+		rt->busy ? ", busy polling" : "", locked ? "locked" : "not locked");
+}
+
+/* Touch every page so the first probe does not pay for the page faults */
+void rt_prefault(void *buf, unsigned int len)
+{
+	memset(buf, 0, len);
+}
+
+static double rt_diff_us(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e6 + (b->tv_nsec - a->tv_nsec) / 1e3;
+}
+
+/*
+ * The client timestamps with CLOCK_MONOTONIC around a blocking recv. The
+ * cost of one clock read and how late a short sleep wakes up bound what the
+ * tool itself contributes to a measured rtt.
+ */
+void rt_measure(struct rt_overhead *ov)
+{
+	struct timespec start, end, req, ts;
+	double late;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < RT_CLOCK_SAMPLES; i++)
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ov->clock = rt_diff_us(&start, &end) / RT_CLOCK_SAMPLES;
+
+	ov->wake_min = ov->wake_max = ov->wake_avg = 0;
+	req.tv_sec = 0;
+	req.tv_nsec = RT_WAKE_US * 1000L;
+	for (i = 0; i < RT_WAKE_SAMPLES; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		nanosleep(&req, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		late = rt_diff_us(&start, &end) - RT_WAKE_US;
+		if (!i || late < ov->wake_min)
+			ov->wake_min = late;
+		if (late > ov->wake_max)
+			ov->wake_max = late;
+		ov->wake_avg += late / RT_WAKE_SAMPLES;
+	}
+}
@@ -0,0 +1,51 @@
+/*
+ * Low jitter measurement setup of the wpan-ping client
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_RT_H
+#define __WPAN_PING_RT_H
+
+#include <stdbool.h>
+
+/* Sleep requested per sample when measuring the wakeup latency */
+#define RT_WAKE_US 100
+#define RT_WAKE_SAMPLES 200
+#define RT_CLOCK_SAMPLES 10000
+/* Stack touched up front so the measurement loop never faults it in */
+#define RT_STACK_PREFAULT (64 * 1024)
+
+struct rt_opts {
+	bool enabled;
+	int cpu; /* -1 for the CPU the client started on */
+	int fifo_prio; /* 0 keeps the normal scheduling class */
+	bool busy;
+};
+
+/* What the client itself adds to every rtt, in us */
+struct rt_overhead {
+	double clock;
+	double wake_min;
+	double wake_avg;
+	double wake_max;
+};
+
+/* cpu=n,fifo[=prio],busy, all optional */
+int rt_parse(const char *opts, struct rt_opts *rt);
+/* Applies to the calling thread only, failures are reported, not fatal */
+void rt_enter(const struct rt_opts *rt);
+void rt_prefault(void *buf, unsigned int len);
+void rt_measure(struct rt_overhead *ov);
+
+#endif /* __WPAN_PING_RT_H */
@@ -0,0 +1,232 @@
+/*
+ * Binary RTT trace format shared by wpan-ping and wpan-trace
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+struct trace_writer {
+	FILE *f;
+	struct trace_header hdr;
+	struct trace_block *block;
+	struct trace_columns cols;
+	uint64_t num_records;
+};
+
+size_t trace_block_len(uint32_t block_records)
+{
+	/* Every column length is a multiple of 8 while block_records is */
+	return sizeof(struct trace_block) +
+	       block_records * (sizeof(uint64_t) * 2 + sizeof(uint32_t) * 2 +
+				sizeof(uint16_t) + sizeof(uint8_t));
+}
+
+void trace_block_columns(const struct trace_block *block, uint32_t block_records,
+			 struct trace_columns *cols)
+{
+	char *p = (char *)(block + 1);
+
+	cols->tx_us = (uint64_t *)p;
+	p += block_records * sizeof(uint64_t);
+	cols->addr = (uint64_t *)p;
+	p += block_records * sizeof(uint64_t);
+	cols->rtt_us = (uint32_t *)p;
+	p += block_records * sizeof(uint32_t);
+	cols->seq = (uint32_t *)p;
+	p += block_records * sizeof(uint32_t);
+	cols->size = (uint16_t *)p;
+	p += block_records * sizeof(uint16_t);
+	cols->status = (uint8_t *)p;
+}
+
+static int trace_write_header(struct trace_writer *tw)
+{
+	struct trace_header hdr = tw->hdr;
+
+	hdr.version = htole16(hdr.version);
+	hdr.header_len = htole16(hdr.header_len);
+	hdr.block_records = htole32(hdr.block_records);
+	hdr.block_len = htole32(hdr.block_len);
+	hdr.flags = htole32(hdr.flags);
+	hdr.start_us = htole64(hdr.start_us);
+	hdr.num_records = htole64(hdr.num_records);
+
+	return fwrite(&hdr, sizeof(hdr), 1, tw->f) == 1 ? 0 : -EIO;
+}
+
+struct trace_writer *trace_writer_open(FILE *f, uint64_t start_us)
+{
+	struct trace_writer *tw;
+
+	tw = calloc(1, sizeof(*tw));
+	if (!tw)
+		return NULL;
+
+	tw->f = f;
+	memcpy(tw->hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	tw->hdr.version = TRACE_VERSION;
+	tw->hdr.header_len = sizeof(struct trace_header);
+	tw->hdr.block_records = TRACE_BLOCK_RECORDS;
+	tw->hdr.block_len = trace_block_len(TRACE_BLOCK_RECORDS);
+	tw->hdr.start_us = start_us;
+
+	tw->block = calloc(1, tw->hdr.block_len);
+	if (!tw->block || trace_write_header(tw)) {
+		free(tw->block);
+		free(tw);
+		return NULL;
+	}
+	trace_block_columns(tw->block, TRACE_BLOCK_RECORDS, &tw->cols);
+
+	return tw;
+}
+
+static int trace_write_block(struct trace_writer *tw)
+{
+	int ret;
+
+	tw->block->count = htole32(tw->block->count);
+	tw->block->first_tx_us = htole64(tw->block->first_tx_us);
+	ret = fwrite(tw->block, tw->hdr.block_len, 1, tw->f) == 1 ? 0 : -EIO;
+	memset(tw->block, 0, tw->hdr.block_len);
+
+	return ret;
+}
+
+int trace_writer_append(struct trace_writer *tw, const struct probe_record *r)
+{
+	uint32_t i = tw->block->count;
+	uint64_t rtt;
+
+	if (r->extended)
+		tw->hdr.flags |= TRACE_FLAG_EXTENDED;
+
+	rtt = TRACE_RTT_NONE;
+	if (r->rx_us && r->rx_us >= r->tx_us) {
+		rtt = r->rx_us - r->tx_us;
+		if (rtt >= TRACE_RTT_NONE)
+			rtt = TRACE_RTT_NONE - 1;
+	}
+
+	if (!i)
+		tw->block->first_tx_us = r->tx_us;
+	tw->cols.tx_us[i] = htole64(r->tx_us);
+	tw->cols.addr[i] = htole64(r->addr);
+	tw->cols.rtt_us[i] = htole32(rtt);
+	tw->cols.seq[i] = htole32(r->seq);
+	tw->cols.size[i] = htole16(r->size);
+	tw->cols.status[i] = r->status;
+	tw->block->count++;
+	tw->num_records++;
+
+	if (tw->block->count == TRACE_BLOCK_RECORDS)
+		return trace_write_block(tw);
+
+	return 0;
+}
+
+int trace_writer_close(struct trace_writer *tw)
+{
+	int ret = 0;
+
+	if (tw->block->count)
+		ret = trace_write_block(tw);
+
+	/* Fill in the record count if the output is seekable */
+	tw->hdr.num_records = tw->num_records;
+	if (!ret && !fseek(tw->f, 0, SEEK_SET)) {
+		ret = trace_write_header(tw);
+		fseek(tw->f, 0, SEEK_END);
+	}
+
+	free(tw->block);
+	free(tw);
+	return ret;
+}
+
+int trace_map_open(const char *path, struct trace_map *map)
+{
+	const struct trace_header *hdr;
+	struct stat st;
+	size_t block_len;
+	int fd, err;
+
+	memset(map, 0, sizeof(*map));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st)) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	map->len = st.st_size;
+	map->base = mmap(NULL, map->len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map->base == MAP_FAILED)
+		return -errno;
+
+	/* Blocks are scanned front to back */
+	madvise(map->base, map->len, MADV_SEQUENTIAL);
+
+	hdr = map->base;
+	block_len = le32toh(hdr->block_len);
+	if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) ||
+	    le16toh(hdr->version) != TRACE_VERSION ||
+	    le16toh(hdr->header_len) < sizeof(*hdr) ||
+	    !le32toh(hdr->block_records) || le32toh(hdr->block_records) % 8 ||
+	    block_len != trace_block_len(le32toh(hdr->block_records))) {
+		munmap(map->base, map->len);
+		return -EINVAL;
+	}
+
+	map->hdr = hdr;
+	map->num_blocks = (map->len - le16toh(hdr->header_len)) / block_len;
+
+	return 0;
+}
+
+const struct trace_block *trace_map_block(const struct trace_map *map, uint64_t i)
+{
+	return (const struct trace_block *)((const char *)map->base +
+		le16toh(map->hdr->header_len) + i * le32toh(map->hdr->block_len));
+}
+
+void trace_map_close(struct trace_map *map)
+{
+	if (map->base)
+		munmap(map->base, map->len);
+	memset(map, 0, sizeof(*map));
+}
@@ -0,0 +1,96 @@
+/*
+ * Binary RTT trace format shared by wpan-ping and wpan-trace
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_TRACE_H
+#define __WPAN_PING_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "record.h"
+
+/*
+ * A trace is a fixed header followed by fixed size blocks. Each block holds
+ * up to block_records probes stored column by column, so a scan over one
+ * quantity touches only its own contiguous array and a block can be found
+ * by offset alone. Blocks are always written in full, the unused tail of
+ * the last block is zero. All fields are little endian.
+ *
+ *	struct trace_header
+ *	block 0: struct trace_block, tx_us[], addr[], rtt_us[], seq[],
+ *		 size[], status[]
+ *	block 1: ...
+ */
+#define TRACE_MAGIC "WPANTRC"
+#define TRACE_VERSION 1
+#define TRACE_BLOCK_RECORDS 4096
+/* rtt_us of probes that did not get a reply */
+#define TRACE_RTT_NONE UINT32_MAX
+
+#define TRACE_FLAG_EXTENDED 0x1
+
+struct trace_header {
+	char magic[8];
+	uint16_t version;
+	uint16_t header_len;
+	uint32_t block_records;
+	uint32_t block_len;
+	uint32_t flags;
+	/* time the trace was started, us since the epoch */
+	uint64_t start_us;
+	/* 0 if the writer could not seek back to fill it in */
+	uint64_t num_records;
+	uint64_t reserved[4];
+};
+
+struct trace_block {
+	uint32_t count;
+	uint32_t reserved;
+	uint64_t first_tx_us;
+};
+
+struct trace_columns {
+	uint64_t *tx_us;
+	uint64_t *addr;
+	uint32_t *rtt_us;
+	uint32_t *seq;
+	uint16_t *size;
+	uint8_t *status;
+};
+
+size_t trace_block_len(uint32_t block_records);
+void trace_block_columns(const struct trace_block *block, uint32_t block_records,
+			 struct trace_columns *cols);
+
+struct trace_writer;
+
+struct trace_writer *trace_writer_open(FILE *f, uint64_t start_us);
+int trace_writer_append(struct trace_writer *tw, const struct probe_record *r);
+/* Writes the last partial block and fills in the header, f stays open */
+int trace_writer_close(struct trace_writer *tw);
+
+struct trace_map {
+	void *base;
+	size_t len;
+	const struct trace_header *hdr;
+	uint64_t num_blocks;
+};
+
+int trace_map_open(const char *path, struct trace_map *map);
+const struct trace_block *trace_map_block(const struct trace_map *map, uint64_t i);
+void trace_map_close(struct trace_map *map);
+
+#endif /* __WPAN_PING_TRACE_H */
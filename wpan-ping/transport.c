@@ -0,0 +1,162 @@
+/*
+ * Packet transports behind the wpan-ping engine
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "transport.h"
+#include "capture.h"
+
+int ieee802154_socket(const struct sockaddr_ieee802154 *src)
+{
+	int sd;
+
+	sd = socket(PF_IEEE802154, SOCK_DGRAM, 0);
+	if (sd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	/* Bind socket on this side */
+	if (bind(sd, (const struct sockaddr *)src, sizeof(*src))) {
+		perror("bind");
+		close(sd);
+		return -1;
+	}
+
+	return sd;
+}
+
+static int ieee802154_init(struct transport *t, const char *opts)
+{
+	return opts && *opts ? -EINVAL : 0;
+}
+
+static int ieee802154_open(struct transport *t,
+			   const struct sockaddr_ieee802154 *src)
+{
+	t->fd = ieee802154_socket(src);
+	return t->fd < 0 ? -1 : 0;
+}
+
+static ssize_t ieee802154_send(struct transport *t, const void *buf, size_t len,
+			       const struct sockaddr_ieee802154 *dst)
+{
+	return sendto(t->fd, buf, len, 0, (const struct sockaddr *)dst,
+		      sizeof(*dst));
+}
+
+static ssize_t ieee802154_recv(struct transport *t, void *buf, size_t len,
+			       int flags, struct sockaddr_ieee802154 *src)
+{
+	socklen_t addrlen = sizeof(*src);
+
+	if (!src)
+		return recv(t->fd, buf, len, flags);
+	return recvfrom(t->fd, buf, len, flags, (struct sockaddr *)src, &addrlen);
+}
+
+static int ieee802154_addr(struct transport *t, struct sockaddr_ieee802154 *sa)
+{
+	socklen_t addrlen = sizeof(*sa);
+
+	return getsockname(t->fd, (struct sockaddr *)sa, &addrlen);
+}
+
+static void ieee802154_close(struct transport *t)
+{
+	shutdown(t->fd, SHUT_RDWR);
+	close(t->fd);
+}
+
+const struct transport_ops ieee802154_transport = {
+	.name = "ieee802154",
+	.flags = TRANSPORT_NATIVE,
+	.init = ieee802154_init,
+	.open = ieee802154_open,
+	.send = ieee802154_send,
+	.recv = ieee802154_recv,
+	.addr = ieee802154_addr,
+	.close = ieee802154_close,
+};
+
+static const struct transport_ops *transports[] = {
+	&ieee802154_transport,
+	&loop_transport,
+};
+
+struct transport *transport_new(const char *spec)
+{
+	const struct transport_ops *ops = NULL;
+	const char *opts;
+	struct transport *t;
+	size_t len;
+	unsigned int i;
+	int err;
+
+	opts = strchr(spec, ':');
+	len = opts ? (size_t)(opts - spec) : strlen(spec);
+	if (opts)
+		opts++;
+
+	for (i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+		if (strlen(transports[i]->name) == len &&
+		    !strncmp(transports[i]->name, spec, len))
+			ops = transports[i];
+	}
+	if (!ops) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->ops = ops;
+	t->fd = -1;
+	/* A failed init may leave t->priv behind */
+	err = ops->init(t, opts);
+	if (err) {
+		transport_free(t);
+		errno = -err;
+		return NULL;
+	}
+
+	return t;
+}
+
+void transport_capture(struct transport *t, uint64_t ts_us, const void *buf,
+		       size_t len, const struct sockaddr_ieee802154 *peer,
+		       bool inbound)
+{
+	capture_frame(t->capture, ts_us, buf, len, &peer->addr, inbound);
+}
+
+void transport_free(struct transport *t)
+{
+	if (!t)
+		return;
+	free(t->priv);
+	free(t);
+}
@@ -0,0 +1,124 @@
+/*
+ * Packet transports behind the wpan-ping engine
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_TRANSPORT_H
+#define __WPAN_PING_TRANSPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "addr.h"
+
+/* The fd is a real AF_IEEE802154 socket, usable with io_uring and recvmmsg */
+#define TRANSPORT_NATIVE 0x1
+/* Largest header a backend puts in front of each frame on its fd */
+#define TRANSPORT_MAX_HDR 32
+
+struct transport;
+struct capture;
+
+/*
+ * A backend moves datagrams between the engine and a peer. Whatever it does
+ * internally, t->fd must become readable when a reply is pending and honour
+ * SO_RCVTIMEO, the engine polls and times out on it directly. init returns
+ * a negative errno, t->priv is freed by transport_free even if it failed.
+ *
+ * A backend that is not native may frame datagrams on t->fd with a header of
+ * hdr_len bytes instead. If it provides wrap, which writes the header of the
+ * next frame to dst, the io_uring window engine sends and receives on t->fd
+ * directly.
+ */
+struct transport_ops {
+	const char *name;
+	unsigned int flags;
+	size_t hdr_len;
+	int (*init)(struct transport *t, const char *opts);
+	int (*open)(struct transport *t, const struct sockaddr_ieee802154 *src);
+	ssize_t (*send)(struct transport *t, const void *buf, size_t len,
+			const struct sockaddr_ieee802154 *dst);
+	ssize_t (*recv)(struct transport *t, void *buf, size_t len, int flags,
+			struct sockaddr_ieee802154 *src);
+	int (*addr)(struct transport *t, struct sockaddr_ieee802154 *sa);
+	void (*close)(struct transport *t);
+	void (*wrap)(struct transport *t, void *hdr,
+		     const struct sockaddr_ieee802154 *dst);
+};
+
+struct transport {
+	const struct transport_ops *ops;
+	int fd;
+	unsigned int mtu; /* 0 for the MTU of the interface */
+	void *priv;
+	struct capture *capture; /* frames the engine hands to transport_capture */
+};
+
+extern const struct transport_ops ieee802154_transport;
+extern const struct transport_ops loop_transport;
+
+/* name[:options], e.g. "ieee802154" or "loop:delay=5,loss=10" */
+struct transport *transport_new(const char *spec);
+void transport_free(struct transport *t);
+
+int ieee802154_socket(const struct sockaddr_ieee802154 *src);
+/* The engine captures with its own tx and rx stamps, in wall clock us */
+void transport_capture(struct transport *t, uint64_t ts_us, const void *buf,
+		       size_t len, const struct sockaddr_ieee802154 *peer,
+		       bool inbound);
+
+static inline int transport_open(struct transport *t,
+				 const struct sockaddr_ieee802154 *src)
+{
+	return t->ops->open(t, src);
+}
+
+static inline ssize_t transport_send(struct transport *t, const void *buf,
+				     size_t len,
+				     const struct sockaddr_ieee802154 *dst)
+{
+	return t->ops->send(t, buf, len, dst);
+}
+
+static inline ssize_t transport_recv(struct transport *t, void *buf, size_t len,
+				     int flags, struct sockaddr_ieee802154 *src)
+{
+	return t->ops->recv(t, buf, len, flags, src);
+}
+
+static inline int transport_addr(struct transport *t,
+				 struct sockaddr_ieee802154 *sa)
+{
+	return t->ops->addr(t, sa);
+}
+
+static inline void transport_close(struct transport *t)
+{
+	t->ops->close(t);
+}
+
+static inline bool transport_native(const struct transport *t)
+{
+	return t->ops->flags & TRANSPORT_NATIVE;
+}
+
+/* Bytes in front of each frame on t->fd, 0 for a native socket */
+static inline size_t transport_hdr_len(const struct transport *t)
+{
+	return transport_native(t) ? 0 : t->ops->hdr_len;
+}
+
+#endif /* __WPAN_PING_TRANSPORT_H */
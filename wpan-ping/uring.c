@@ -0,0 +1,407 @@
+/*
+ * Minimal io_uring wrapper for the wpan-ping client
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+struct uring {
+	int fd;
+	unsigned int entries;
+	/* io_uring_enter takes a timeout, else the ring fd is polled */
+	bool ext_arg;
+
+	/* submission queue */
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned int sqe_tail;
+	unsigned int to_submit;
+
+	/* completion queue */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/* timeouts must stay valid until the kernel consumed the sqe */
+	struct __kernel_timespec *timeouts;
+
+	void *sq_ring;
+	size_t sq_ring_len;
+	void *cq_ring;
+	size_t cq_ring_len;
+	size_t sqes_len;
+};
+
+static int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned int to_submit,
+			      unsigned int min_complete, unsigned int flags,
+			      void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		       arg, argsz);
+}
+
+struct uring *uring_new(unsigned int entries)
+{
+	struct io_uring_params p;
+	struct uring *ring;
+	int err;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	memset(&p, 0, sizeof(p));
+	ring->fd = sys_io_uring_setup(entries, &p);
+	if (ring->fd < 0) {
+		free(ring);
+		return NULL;
+	}
+	ring->entries = p.sq_entries;
+#ifdef IORING_FEAT_EXT_ARG
+	ring->ext_arg = p.features & IORING_FEAT_EXT_ARG;
+#endif
+
+	ring->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_len > ring->sq_ring_len)
+			ring->sq_ring_len = ring->cq_ring_len;
+		ring->cq_ring_len = ring->sq_ring_len;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+		goto err_close;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ring->fd,
+				     IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED)
+			goto err_unmap_sq;
+	}
+
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto err_unmap_cq;
+
+	ring->timeouts = calloc(p.sq_entries, sizeof(*ring->timeouts));
+	if (!ring->timeouts)
+		goto err_unmap_sqes;
+
+	ring->sq_head = (unsigned int *)((char *)ring->sq_ring + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)((char *)ring->sq_ring + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((char *)ring->sq_ring + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((char *)ring->sq_ring + p.sq_off.array);
+	ring->sqe_tail = *ring->sq_tail;
+
+	ring->cq_head = (unsigned int *)((char *)ring->cq_ring + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)ring->cq_ring + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((char *)ring->cq_ring + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring + p.cq_off.cqes);
+
+	return ring;
+
+err_unmap_sqes:
+	munmap(ring->sqes, ring->sqes_len);
+err_unmap_cq:
+	if (ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+err_unmap_sq:
+	munmap(ring->sq_ring, ring->sq_ring_len);
+err_close:
+	err = errno;
+	close(ring->fd);
+	free(ring);
+	errno = err;
+	return NULL;
+}
+
+void uring_free(struct uring *ring)
+{
+	if (!ring)
+		return;
+
+	free(ring->timeouts);
+	munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	munmap(ring->sq_ring, ring->sq_ring_len);
+	close(ring->fd);
+	free(ring);
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring *ring, unsigned int *idx)
+{
+	unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	struct io_uring_sqe *sqe;
+
+	if (ring->sqe_tail - head >= ring->entries)
+		return NULL;
+
+	*idx = ring->sqe_tail & *ring->sq_mask;
+	sqe = &ring->sqes[*idx];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[*idx] = *idx;
+	ring->sqe_tail++;
+	ring->to_submit++;
+
+	return sqe;
+}
+
+int uring_prep_sendmsg(struct uring *ring, int fd, const struct msghdr *msg,
+		       uint64_t user_data, bool link)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	sqe = uring_get_sqe(ring, &idx);
+	if (!sqe)
+		return -EBUSY;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)msg;
+	sqe->len = 1;
+	sqe->user_data = user_data;
+	if (link)
+		sqe->flags |= IOSQE_IO_LINK;
+
+	return 0;
+}
+
+int uring_prep_recv(struct uring *ring, int fd, void *buf, unsigned int len,
+		    uint64_t user_data, bool link)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	sqe = uring_get_sqe(ring, &idx);
+	if (!sqe)
+		return -EBUSY;
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->user_data = user_data;
+	if (link)
+		sqe->flags |= IOSQE_IO_LINK;
+
+	return 0;
+}
+
+int uring_prep_link_timeout(struct uring *ring, unsigned int timeout_ms,
+			    uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	sqe = uring_get_sqe(ring, &idx);
+	if (!sqe)
+		return -EBUSY;
+
+	ring->timeouts[idx].tv_sec = timeout_ms / 1000;
+	ring->timeouts[idx].tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+	sqe->opcode = IORING_OP_LINK_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uintptr_t)&ring->timeouts[idx];
+	sqe->len = 1;
+	sqe->user_data = user_data;
+
+	return 0;
+}
+
+int uring_prep_cancel(struct uring *ring, uint64_t target, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	sqe = uring_get_sqe(ring, &idx);
+	if (!sqe)
+		return -EBUSY;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = target;
+	sqe->user_data = user_data;
+
+	return 0;
+}
+
+/*
+ * Entries the kernel did not take, e.g. when interrupted before it got to
+ * them, stay queued and go out with the next call.
+ */
+static int uring_enter(struct uring *ring, unsigned int wait_nr,
+		       unsigned int flags, void *arg, size_t argsz)
+{
+	unsigned int to_submit = ring->to_submit;
+	int ret;
+
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+	ret = sys_io_uring_enter(ring->fd, to_submit, wait_nr,
+				 (wait_nr ? IORING_ENTER_GETEVENTS : 0) | flags,
+				 arg, argsz);
+	if (ret < 0)
+		return -errno;
+	ring->to_submit = to_submit > (unsigned int)ret ? to_submit - ret : 0;
+	return ret;
+}
+
+int uring_submit_and_wait(struct uring *ring, unsigned int wait_nr)
+{
+	int ret;
+
+	do {
+		ret = uring_enter(ring, wait_nr, 0, NULL, 0);
+	} while (ret == -EINTR);
+
+	return ret;
+}
+
+int uring_submit_and_wait_timeout(struct uring *ring, unsigned int wait_nr,
+				  unsigned int timeout_us)
+{
+	struct pollfd pfd;
+	int ret, n;
+
+#ifdef IORING_FEAT_EXT_ARG
+	if (ring->ext_arg) {
+		struct __kernel_timespec ts;
+		struct io_uring_getevents_arg arg;
+
+		ts.tv_sec = timeout_us / 1000000;
+		ts.tv_nsec = (timeout_us % 1000000) * 1000L;
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (uintptr_t)&ts;
+
+		return uring_enter(ring, wait_nr, IORING_ENTER_EXT_ARG, &arg,
+				   sizeof(arg));
+	}
+#endif
+
+	/* Older kernels: submit, then poll the ring for completions */
+	ret = uring_enter(ring, 0, 0, NULL, 0);
+	if (ret < 0 || !wait_nr)
+		return ret;
+
+	pfd.fd = ring->fd;
+	pfd.events = POLLIN;
+	n = poll(&pfd, 1, (timeout_us + 999) / 1000);
+	if (n < 0)
+		return -errno;
+	return n || ret ? ret : -ETIME;
+}
+
+int uring_reap(struct uring *ring, uint64_t *user_data, int *res)
+{
+	unsigned int head = *ring->cq_head;
+	struct io_uring_cqe *cqe;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+
+	cqe = &ring->cqes[head & *ring->cq_mask];
+	*user_data = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+#else /* HAVE_LINUX_IO_URING_H */
+
+struct uring *uring_new(unsigned int entries)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+void uring_free(struct uring *ring)
+{
+}
+
+int uring_prep_sendmsg(struct uring *ring, int fd, const struct msghdr *msg,
+		       uint64_t user_data, bool link)
+{
+	return -ENOSYS;
+}
+
+int uring_prep_recv(struct uring *ring, int fd, void *buf, unsigned int len,
+		    uint64_t user_data, bool link)
+{
+	return -ENOSYS;
+}
+
+int uring_prep_link_timeout(struct uring *ring, unsigned int timeout_ms,
+			    uint64_t user_data)
+{
+	return -ENOSYS;
+}
+
+int uring_prep_cancel(struct uring *ring, uint64_t target, uint64_t user_data)
+{
+	return -ENOSYS;
+}
+
+int uring_submit_and_wait(struct uring *ring, unsigned int wait_nr)
+{
+	return -ENOSYS;
+}
+
+int uring_submit_and_wait_timeout(struct uring *ring, unsigned int wait_nr,
+				  unsigned int timeout_us)
+{
+	return -ENOSYS;
+}
+
+int uring_reap(struct uring *ring, uint64_t *user_data, int *res)
+{
+	return 0;
+}
+
+#endif /* HAVE_LINUX_IO_URING_H */
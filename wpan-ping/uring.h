@@ -0,0 +1,54 @@
+/*
+ * Minimal io_uring wrapper for the wpan-ping client
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_PING_URING_H
+#define __WPAN_PING_URING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/*
+ * Only the handful of operations the ping engine needs are wrapped. Built
+ * without <linux/io_uring.h> uring_new() always fails with ENOSYS and the
+ * callers fall back to the blocking socket path.
+ */
+struct uring;
+
+struct uring *uring_new(unsigned int entries);
+void uring_free(struct uring *ring);
+
+int uring_prep_sendmsg(struct uring *ring, int fd, const struct msghdr *msg,
+		       uint64_t user_data, bool link);
+int uring_prep_recv(struct uring *ring, int fd, void *buf, unsigned int len,
+		    uint64_t user_data, bool link);
+int uring_prep_link_timeout(struct uring *ring, unsigned int timeout_ms,
+			    uint64_t user_data);
+/* Cancel the request submitted with user_data target */
+int uring_prep_cancel(struct uring *ring, uint64_t target, uint64_t user_data);
+
+/* Submit all prepared entries and wait for at least wait_nr completions */
+int uring_submit_and_wait(struct uring *ring, unsigned int wait_nr);
+/*
+ * Same, but give up after timeout_us. Returns -ETIME or -EINTR if nothing
+ * was submitted and no completion arrived in time, these are not errors.
+ */
+int uring_submit_and_wait_timeout(struct uring *ring, unsigned int wait_nr,
+				  unsigned int timeout_us);
+/* Pop one completion, returns 0 if the completion queue is empty */
+int uring_reap(struct uring *ring, uint64_t *user_data, int *res);
+
+#endif /* __WPAN_PING_URING_H */
@@ -21,13 +21,21 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <net/if.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
@@ -42,33 +50,101 @@
 #include <netlink/attr.h>
 
 #include "../src/nl802154.h"
+#include "uring.h"
+#include "record.h"
+#include "transport.h"
+#include "phyctl.h"
+#include "owd.h"
+#include "peers.h"
+#include "rt.h"
+#include "capture.h"
 
 #define MIN_PAYLOAD_LEN 5
-#define MAX_PAYLOAD_LEN 105 //116 with short address
-#define IEEE802154_ADDR_LEN 8
+#define PACKET_TIMEOUT_MS 500
+/* Bounds for the adaptive timeout, RFC 6298's 1 s minimum is far too long */
+#define RTO_MIN_MS 10
+#define RTO_MAX_MS 5000
+/* Probes per payload size in --sweep-size mode if no count is given */
+#define SWEEP_SIZE_PACKETS 10
+#define SWEEP_SIZE_STEP 10
+/* Spacing of the probes of a multi target sweep, about one legacy frame */
+#define SWEEP_TX_GAP_MS 5
+/*
+ * Legacy PHYs carry 127 byte PSDUs, the SUN PHYs of 802.15.4g up to 2047.
+ * The MAC header with PAN ID compression plus FCS takes 11 bytes with short
+ * and 23 bytes with extended addressing, the rest is payload.
+ */
+#define IEEE802154_MTU 127
+#define MAX_FRAME_LEN 2047
+#define SHORT_FRAME_OVERHEAD 11
+#define EXTENDED_FRAME_OVERHEAD 23
+/* Upper bound for buffers, the usable size depends on the interface MTU */
+#define MAX_PAYLOAD_LEN (MAX_FRAME_LEN - SHORT_FRAME_OVERHEAD)
+#define MTU_PROBE_TRIES 3
+/*
+ * The upper half of a 32 bit sequence follows the lower one. A marker after
+ * the timestamp request byte tells it from the 0xAB filler of older clients.
+ */
+#define WIDE_SEQ_OFFSET 4
+#define WIDE_SEQ_MARKER_OFFSET 7
+#define WIDE_SEQ_MARKER 0x53
+#define WIDE_SEQ_PAYLOAD_LEN 8
+/* Seconds between soak summaries, log-linear rtt histogram in us */
+#define SOAK_INTERVAL_S 60
+#define RTT_HIST_SUB_BITS 5
+#define RTT_HIST_SIZE (27 << RTT_HIST_SUB_BITS)
+/* Probes tracked for late and duplicate replies, must divide 65536 */
+#define SEQ_WINDOW 1024
+/* Data frames in flight, must divide 65536. Older ones count as lost */
+#define DUPLEX_WINDOW 1024
+#define DUPLEX_SECONDS 10
+/* Probes per CSMA/retry combination if no count is given */
+#define TUNE_PACKETS 100
+#define TUNE_PASSES 3
+/* Defaults of the tx power sweep: probes per level and destination, limits */
+#define POWER_PACKETS 50
+#define POWER_MAX_LOSS 1.0f
+#define POWER_MAX_P99_MS 100.0f
+#define MAX_TARGETS_POWER 64
+#define DUPLEX_DATA 0xd1
+#define DUPLEX_ACK 0xd2
+#define DUPLEX_MAX_RATE 1000000
+/*
+ * Data frames announce how many the sender sends in total, and the average
+ * and maximum rtt in us it has seen so far, the other side's inbound latency
+ */
+#define DUPLEX_TOTAL_OFFSET 4
+#define DUPLEX_RTT_OFFSET 8
+#define DUPLEX_PAYLOAD_LEN 16
+#define DISCOVER_WINDOW_MS 2000
+#define DISCOVER_ROUNDS 3
+/* Discovery probes are marked in the byte of the timestamp request marker */
+#define DISCOVER_MAGIC_OFFSET OWD_MAGIC_OFFSET
+#define DISCOVER_MAGIC 0x44
+/* The reply spread follows the wide sequence, whose marker shares byte 7 */
+#define DISCOVER_SPREAD_OFFSET WIDE_SEQ_PAYLOAD_LEN
+#define DISCOVER_PAYLOAD_LEN (DISCOVER_SPREAD_OFFSET + 2)
+#define BROADCAST_SHORT_ADDR 0xffff
+#define MAX_DEFERRED 32
+#define MONITOR_INTERVAL_MS 1000
+#define MONITOR_STATE_S 10
+#define MONITOR_DOWN_AFTER 3
+#define MONITOR_UP_AFTER 2
+#define MONITOR_RTT_GAIN 0.125f
+#define MONITOR_LOSS_GAIN 0.0625f
+#define MAX_NEIGHBORS 1024
+#define BUSY_POLL_SAMPLES 10000
+#define MAX_INTERFACES 16
+#define MAX_BATCH 64
+#define ECHO_TX_WAIT_MS 1000
+#define URING_ABORT_TRIES 10
+/* Probes in flight and posted receives of the windowed io_uring engine */
+#define URING_WINDOW_MAX SEQ_WINDOW
+#define URING_RECV_DEPTH 16
+#define BATCH_HIST_SIZE 7 /* log2 buckets 1, 2-3, ... 64 */
 /* Set the dispatch header to not 6lowpan for compat */
 #define NOT_A_6LOWPAN_FRAME 0x00
 
-enum {
-	IEEE802154_ADDR_NONE = 0x0,
-	IEEE802154_ADDR_SHORT = 0x2,
-	IEEE802154_ADDR_LONG = 0x3,
-};
-
-struct ieee802154_addr_sa {
-	int addr_type;
-	uint16_t pan_id;
-	union {
-		uint8_t hwaddr[IEEE802154_ADDR_LEN];
-		uint16_t short_addr;
-	};
-};
-
-struct sockaddr_ieee802154 {
-	sa_family_t family;
-	struct ieee802154_addr_sa addr;
-};
-
 #ifdef HAVE_GETOPT_LONG
 static const struct option perf_long_opts[] = {
 	{ "daemon", no_argument, NULL, 'd' },
@@ -77,37 +153,271 @@ static const struct option perf_long_opts[] = {
 	{ "count", required_argument, NULL, 'c' },
 	{ "size", required_argument, NULL, 's' },
 	{ "interface", required_argument, NULL, 'i' },
+	{ "batch", required_argument, NULL, 'b' },
+	{ "uring", no_argument, NULL, 'u' },
+	{ "window", required_argument, NULL, 'N' },
+	{ "targets", required_argument, NULL, 'f' },
+	{ "adaptive", no_argument, NULL, 'A' },
+	{ "interval", required_argument, NULL, 't' },
+	{ "deadline", required_argument, NULL, 'w' },
+	{ "record", required_argument, NULL, 'r' },
+	{ "record-format", required_argument, NULL, 'R' },
+	{ "quiet", no_argument, NULL, 'q' },
+	{ "sweep-size", optional_argument, NULL, 'S' },
+	{ "probe-mtu", no_argument, NULL, 'M' },
+	{ "transport", required_argument, NULL, 'T' },
+	{ "duplex", required_argument, NULL, 'D' },
+	{ "tune-mac", no_argument, NULL, 'C' },
+	{ "power-sweep", optional_argument, NULL, 'P' },
+	{ "soak", optional_argument, NULL, 'k' },
+	{ "timestamps", no_argument, NULL, 'x' },
+	{ "discover", optional_argument, NULL, 'B' },
+	{ "monitor", optional_argument, NULL, 'm' },
+	{ "rt", optional_argument, NULL, 'L' },
+	{ "pcap", required_argument, NULL, 'W' },
 	{ "version", no_argument, NULL, 'v' },
 	{ "help", no_argument, NULL, 'h' },
 	{ NULL, 0, NULL, 0 },
 };
 #endif
 
+/* Addressing of one wpan interface as reported by nl802154 */
+struct wpan_iface {
+	char name[IFNAMSIZ];
+	uint16_t pan_id;
+	uint16_t short_addr;
+	uint64_t extended_addr;
+	unsigned int mtu;
+};
+
+/* One socket of the echo server together with its counters */
+struct server_iface {
+	const struct wpan_iface *iface;
+	int sd;
+	unsigned long rx_packets;
+	unsigned long tx_packets;
+	unsigned long rx_bytes;
+	unsigned long tx_bytes;
+	unsigned long errors;
+	unsigned long batches;
+	unsigned long batch_hist[BATCH_HIST_SIZE];
+	unsigned int batch_max;
+	struct peer_table peers;
+};
+
+/* Preallocated ring for the batched echo path, shared by all interfaces */
+struct echo_batch {
+	unsigned char bufs[MAX_BATCH][MAX_PAYLOAD_LEN];
+	struct sockaddr_ieee802154 addrs[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	struct mmsghdr msgs[MAX_BATCH];
+};
+
+/* Discovery replies held back by their random backoff */
+struct deferred_echo {
+	struct server_iface *sif;
+	uint64_t due_us;
+	struct sockaddr_ieee802154 dst;
+	size_t len;
+	unsigned char buf[MAX_PAYLOAD_LEN];
+};
+
+struct echo_queue {
+	struct deferred_echo slots[MAX_DEFERRED];
+	unsigned int num;
+};
+
+/* Smoothed RTT estimator as described in RFC 6298, all values in ms */
+struct rto_estimator {
+	bool valid;
+	float srtt;
+	float rttvar;
+	float rto;
+};
+
+/* Results of one run of the probe engine, rtts in ms */
+struct ping_stats {
+	unsigned int sent;
+	unsigned int received;
+	float rtt_min;
+	float rtt_max;
+	double rtt_sum;
+	/* Replies other than the one waited for, late ones are not lost */
+	unsigned int late;
+	unsigned int duplicates;
+	unsigned int reordered;
+	/* Optional room for every rtt, e.g. for percentiles */
+	float *rtts;
+	unsigned int num_rtts;
+	unsigned int max_rtts;
+	/* Optional constant size alternative for endless runs */
+	struct rtt_hist *hist;
+};
+
+struct rtt_hist {
+	uint32_t count[RTT_HIST_SIZE];
+};
+
+/* Totals at the last interval summary, the interval is the difference */
+struct soak {
+	struct timeval start;
+	struct timeval last;
+	struct ping_stats snap;
+	struct rtt_hist snap_hist;
+	struct rtt_hist diff;
+};
+
+/* Which of the last SEQ_WINDOW probes of a run got a reply */
+struct seq_window {
+	uint32_t sent;
+	uint32_t highest;
+	bool answered_any;
+	uint64_t answered[SEQ_WINDOW / 64];
+};
+
+enum link_state {
+	LINK_UNKNOWN,
+	LINK_UP,
+	LINK_DOWN,
+};
+
+/* Health of one monitored destination, parallel to conf->targets */
+struct neighbor {
+	enum link_state state;
+	time_t since;
+	time_t last_seen;
+	float rtt; /* EWMA in ms, valid once a reply was seen */
+	float loss; /* EWMA in percent */
+	unsigned int ok_run;
+	unsigned int lost_run;
+	unsigned long sent;
+	unsigned long received;
+};
+
+/* One destination of a multi target sweep */
+struct target {
+	struct sockaddr_ieee802154 addr;
+	uint64_t key;
+	struct timeval tx_time;
+	bool pending;
+	unsigned int sent;
+	unsigned int received;
+	float rtt_min;
+	float rtt_max;
+	float rtt_sum;
+};
+
 struct config {
-	char packet_len;
-	unsigned short packets;
+	unsigned int packet_len;
+	unsigned int max_payload;
+	unsigned int packets;
 	bool extended;
 	bool server;
+	unsigned int batch;
+	bool uring;
+	unsigned int window;
+	bool adaptive;
+	unsigned int interval_ms;
+	unsigned int deadline_s;
+	struct rto_estimator rto;
+	bool quiet;
+	char *record_path;
+	enum record_format record_format;
+	struct recorder *recorder;
+	struct transport *transport;
+	bool sweep_size;
+	unsigned int size_min;
+	unsigned int size_max;
+	unsigned int size_step;
+	bool probe_mtu;
+	unsigned int duplex_rate;
+	bool tune_mac;
+	bool power_sweep;
+	float power_max_loss;
+	float power_max_p99;
+	unsigned int soak_interval_s;
+	struct soak *soak;
+	bool timestamps;
+	struct owd_estimator owd;
+	unsigned int discover_ms;
+	bool monitor;
+	char *monitor_path;
+	struct rt_opts rt;
+	char *pcap_path;
 	char *interface;
 	struct nl_sock *nl_sock;
 	int nl802154_id;
+	struct wpan_iface ifaces[MAX_INTERFACES];
+	int num_ifaces;
 	struct sockaddr_ieee802154 src;
 	struct sockaddr_ieee802154 dst;
+	struct target *targets;
+	int num_targets;
 };
 
+static volatile sig_atomic_t server_stop;
+static volatile sig_atomic_t server_report;
+static volatile sig_atomic_t soak_stop;
+static volatile sig_atomic_t soak_report;
+static volatile sig_atomic_t monitor_stop;
+static volatile sig_atomic_t monitor_report;
+static volatile sig_atomic_t radio_stop;
+
 extern char *optarg;
 
 void usage(const char *name) {
 	printf("Usage: %s OPTIONS\n"
 	"OPTIONS:\n"
 	"--daemon |-d\n"
-	"--address | -a server address\n"
+	"--address | -a server address, a comma separated list or a short address\n"
+	"               range like 0x0001-0x012c sweeps all of them in parallel\n"
 	"--extended | -e use extended addressing scheme 00:11:22:...\n"
 	"--count | -c number of packets\n"
-	"--size | -s packet length\n"
-	"--interface | -i listen on this interface (default wpan0)\n"
+	"--size | -s packet length, limited by the interface MTU\n"
+	"--interface | -i use this interface (default wpan0). In daemon mode a comma\n"
+	"                 separated list or 'all' serves several interfaces at once\n"
+	"--batch | -b echo up to this many packets per syscall in daemon mode (max %i)\n"
+	"--uring | -u use io_uring with per packet linked timeouts in the client\n"
+	"--window | -N with -u keep up to this many probes in flight (max %i),\n"
+	"                 paced by -t, back to back without it\n"
+	"--targets | -f read sweep destinations from this file, one per line\n"
+	"--adaptive | -A adapt the packet timeout to the measured rtt (RFC 6298)\n"
+	"--interval | -t wait this many ms between the start of two probes\n"
+	"--deadline | -w stop after this many seconds, regardless of the count\n"
+	"--record | -r write a record per probe to this file\n"
+	"--record-format | -R csv, ndjson or bin, a trace for wpan-trace (default csv)\n"
+	"--quiet | -q only print the summary, not every reply\n"
+	"--sweep-size | -S[min:max:step] run -c probes (default %i) per payload size\n"
+	"                 and derive per byte airtime and per frame overhead\n"
+	"--probe-mtu | -M binary search the largest payload the peer echoes\n"
+	"--duplex | -D send this many frames per second to a peer doing the same,\n"
+	"                 count both directions while they contend for the channel.\n"
+	"                 The inbound rtt is the one the peer reports in its frames\n"
+	"--tune-mac | -C step CSMA backoff and frame retry settings through the\n"
+	"                 PHY's ranges, run -c probes (default %i) each, keep the best.\n"
+	"                 The link goes down and up for every setting tried\n"
+	"--power-sweep | -P[loss:p99] walk the PHY's tx powers down, -c probes\n"
+	"                 (default %i) per destination, and stop below the lowest\n"
+	"                 level with loss <= loss %% and p99 rtt <= p99 ms (%.0f:%.0f)\n"
+	"--soak | -k[seconds] probe until SIGINT or -w and print a summary every\n"
+	"                 interval (default %i s), SIGUSR1 prints the totals\n"
+	"--timestamps | -x ask the server to stamp its receive and transmit time\n"
+	"                 and split the rtt into forward and return delay\n"
+	"--discover | -B[ms] broadcast -c probes (default %i) and list every server\n"
+	"                 answering within the window (default %i ms)\n"
+	"--monitor | -m[file] probe the destinations in turn, one every -t ms\n"
+	"                 (default %i), track their health until SIGINT and\n"
+	"                 rewrite the state to this file\n"
+	"--rt | -L[cpu=n,fifo[=prio],busy] pin the client to a CPU, lock its memory,\n"
+	"                 optionally run SCHED_FIFO and busy poll for replies,\n"
+	"                 and report the jitter the client itself adds\n"
+	"--pcap | -W write every frame sent and received to this pcapng file\n"
+	"--transport | -T ieee802154 (default) or loop[:delay=ms,jitter=ms,loss=%%,\n"
+	"                 reorder=%%,seed=n,mtu=bytes,nodes=n], an in-process reflector\n"
 	"--version | -v print out version\n"
-	"--help This usage text\n", name);
+	"--help This usage text\n", name, MAX_BATCH, URING_WINDOW_MAX, SWEEP_SIZE_PACKETS, TUNE_PACKETS, POWER_PACKETS,
+	POWER_MAX_LOSS, POWER_MAX_P99_MS, SOAK_INTERVAL_S, DISCOVER_ROUNDS, DISCOVER_WINDOW_MS,
+	MONITOR_INTERVAL_MS);
 }
 
 static int nl802154_init(struct config *conf)
@@ -148,54 +458,137 @@ static void nl802154_cleanup(struct config *conf)
 	nl_socket_free(conf->nl_sock);
 }
 
+/*
+ * The netdev MTU tells whether the PHY supports more than 127 byte frames.
+ * A smaller one is taken as is, 127 is only assumed if it cannot be read.
+ */
+static unsigned int read_iface_mtu(const char *name)
+{
+	char path[64];
+	unsigned int mtu;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/mtu", name);
+	f = fopen(path, "r");
+	if (!f)
+		return IEEE802154_MTU;
+
+	if (fscanf(f, "%u", &mtu) != 1)
+		mtu = IEEE802154_MTU;
+	else if (mtu > MAX_FRAME_LEN)
+		mtu = MAX_FRAME_LEN;
+
+	fclose(f);
+	return mtu;
+}
+
 static int nl_msg_cb(struct nl_msg* msg, void* arg)
 {
 	struct config *conf = arg;
-	struct sockaddr_nl nla;
 	struct nlmsghdr *nlh = nlmsg_hdr(msg);
 	struct nlattr *attrs[NL802154_ATTR_MAX+1];
-	uint64_t temp;
+	struct wpan_iface *iface;
 
 	struct genlmsghdr *gnlh = (struct genlmsghdr*) nlmsg_data(nlh);
 
 	nla_parse(attrs, NL802154_ATTR_MAX, genlmsg_attrdata(gnlh, 0),
 		  genlmsg_attrlen(gnlh, 0), NULL);
 
-	if (!attrs[NL802154_ATTR_SHORT_ADDR] || !attrs[NL802154_ATTR_PAN_ID]
-	    || !attrs[NL802154_ATTR_EXTENDED_ADDR])
+	if (!attrs[NL802154_ATTR_IFNAME] || !attrs[NL802154_ATTR_SHORT_ADDR]
+	    || !attrs[NL802154_ATTR_PAN_ID] || !attrs[NL802154_ATTR_EXTENDED_ADDR])
 		return NL_SKIP;
 
-	conf->src.family = AF_IEEE802154;
-	conf->src.addr.pan_id = conf->dst.addr.pan_id = nla_get_u16(attrs[NL802154_ATTR_PAN_ID]);
-
-	if (!conf->extended) {
-		conf->src.addr.addr_type = IEEE802154_ADDR_SHORT;
-		conf->src.addr.short_addr = nla_get_u16(attrs[NL802154_ATTR_SHORT_ADDR]);
-	} else {
-		conf->src.addr.addr_type = IEEE802154_ADDR_LONG;
-		temp = htobe64(nla_get_u64(attrs[NL802154_ATTR_EXTENDED_ADDR]));
-		memcpy(&conf->src.addr.hwaddr, &temp, IEEE802154_ADDR_LEN);
+	if (conf->num_ifaces >= MAX_INTERFACES) {
+		fprintf(stderr, "More than %d wpan interfaces, ignoring %s.\n",
+			MAX_INTERFACES, nla_get_string(attrs[NL802154_ATTR_IFNAME]));
+		return NL_SKIP;
 	}
 
+	iface = &conf->ifaces[conf->num_ifaces++];
+	snprintf(iface->name, sizeof(iface->name), "%s",
+		 nla_get_string(attrs[NL802154_ATTR_IFNAME]));
+	iface->pan_id = nla_get_u16(attrs[NL802154_ATTR_PAN_ID]);
+	iface->short_addr = nla_get_u16(attrs[NL802154_ATTR_SHORT_ADDR]);
+	iface->extended_addr = nla_get_u64(attrs[NL802154_ATTR_EXTENDED_ADDR]);
+	iface->mtu = read_iface_mtu(iface->name);
+
 	return NL_SKIP;
 }
 
+/* Dump all wpan interfaces, they are looked up by name afterwards */
 static int get_interface_info(struct config *conf) {
 	struct nl_msg *msg;
+	int ret;
 
-	nl802154_init(conf);
+	conf->num_ifaces = 0;
+
+	ret = nl802154_init(conf);
+	if (ret)
+		return ret;
 
 	/* Build and send message */
 	nl_socket_modify_cb(conf->nl_sock, NL_CB_VALID, NL_CB_CUSTOM, nl_msg_cb, conf);
 	msg = nlmsg_alloc();
 	genlmsg_put(msg, NL_AUTO_PORT, NL_AUTO_SEQ, conf->nl802154_id, 0, NLM_F_DUMP, NL802154_CMD_GET_INTERFACE, 0);
-	nla_put_string(msg, NL802154_ATTR_IFNAME, "conf->interface");
 	nl_send_sync(conf->nl_sock, msg);
 
 	nl802154_cleanup(conf);
 	return 0;
 }
 
+/* Transports without netlink get one interface with fixed addresses */
+static void virtual_interface(struct config *conf)
+{
+	struct wpan_iface *iface = &conf->ifaces[0];
+
+	snprintf(iface->name, sizeof(iface->name), "%s", conf->transport->ops->name);
+	iface->pan_id = 0x0777;
+	iface->short_addr = 0x0001;
+	iface->extended_addr = 0x0001020304050607ULL;
+	iface->mtu = conf->transport->mtu;
+	conf->num_ifaces = 1;
+	conf->interface = iface->name;
+}
+
+static const struct wpan_iface *find_interface(struct config *conf, const char *name)
+{
+	int i;
+
+	for (i = 0; i < conf->num_ifaces; i++) {
+		if (!strcmp(conf->ifaces[i].name, name))
+			return &conf->ifaces[i];
+	}
+
+	return NULL;
+}
+
+static unsigned int iface_max_payload(struct config *conf, const struct wpan_iface *iface)
+{
+	unsigned int overhead;
+
+	overhead = conf->extended ? EXTENDED_FRAME_OVERHEAD : SHORT_FRAME_OVERHEAD;
+	return iface->mtu > overhead ? iface->mtu - overhead : 0;
+}
+
+static void fill_src_addr(struct config *conf, const struct wpan_iface *iface,
+			  struct sockaddr_ieee802154 *sa)
+{
+	uint64_t temp;
+
+	memset(sa, 0, sizeof(*sa));
+	sa->family = AF_IEEE802154;
+	sa->addr.pan_id = iface->pan_id;
+
+	if (!conf->extended) {
+		sa->addr.addr_type = IEEE802154_ADDR_SHORT;
+		sa->addr.short_addr = iface->short_addr;
+	} else {
+		sa->addr.addr_type = IEEE802154_ADDR_LONG;
+		temp = htobe64(iface->extended_addr);
+		memcpy(&sa->addr.hwaddr, &temp, IEEE802154_ADDR_LEN);
+	}
+}
+
 static void dump_packet(unsigned char *buf, int len) {
 	int i;
 
@@ -207,19 +600,44 @@ static void dump_packet(unsigned char *buf, int len) {
 }
 
 static int generate_packet(unsigned char *buf, struct config *conf, unsigned int seq_num) {
-	int i;
+	unsigned int i;
 
 	buf[0] = NOT_A_6LOWPAN_FRAME;
-	buf[1] = conf->packet_len;
-	buf[2] = seq_num >> 8; /* Upper byte */
+	buf[1] = conf->packet_len & 0xff; /* Lower byte only for large frames */
+	buf[2] = (seq_num >> 8) & 0xFF; /* Upper byte */
 	buf[3] = seq_num & 0xFF; /* Lower byte */
 	for (i = 4; i < conf->packet_len; i++) {
 		buf[i] = 0xAB;
 	}
+	if (conf->timestamps)
+		owd_request(buf, conf->packet_len);
+	/* Upper 16 bits of the sequence if there is room for them */
+	if (conf->packet_len >= WIDE_SEQ_PAYLOAD_LEN) {
+		buf[WIDE_SEQ_OFFSET] = (seq_num >> 24) & 0xFF;
+		buf[WIDE_SEQ_OFFSET + 1] = (seq_num >> 16) & 0xFF;
+		buf[WIDE_SEQ_MARKER_OFFSET] = WIDE_SEQ_MARKER;
+	}
 
 	return 0;
 }
 
+static bool packet_wide_seq(const unsigned char *buf, unsigned int len)
+{
+	return len >= WIDE_SEQ_PAYLOAD_LEN &&
+	       buf[WIDE_SEQ_MARKER_OFFSET] == WIDE_SEQ_MARKER;
+}
+
+/* Sequence of a probe or reply, 32 bits wide if the sender marked it so */
+static uint32_t packet_seq(const unsigned char *buf, unsigned int len)
+{
+	uint32_t seq = (buf[2] << 8) | buf[3];
+
+	if (packet_wide_seq(buf, len))
+		seq |= (uint32_t)((buf[WIDE_SEQ_OFFSET] << 8) |
+				  buf[WIDE_SEQ_OFFSET + 1]) << 16;
+	return seq;
+}
+
 static int print_address(char *addr, uint8_t dst_extended[IEEE802154_ADDR_LEN])
 {
 	snprintf(addr, 24, "%02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x", dst_extended[0],
@@ -228,273 +646,3562 @@ static int print_address(char *addr, uint8_t dst_extended[IEEE802154_ADDR_LEN])
 	return 0;
 }
 
-static int measure_roundtrip(struct config *conf, int sd) {
-	unsigned char *buf;
-	struct timeval start_time, end_time, timeout;
-	long sec = 0, usec = 0;
-	long sec_max = 0, usec_max = 0;
-	long sec_min = 2147483647, usec_min = 2147483647;
-	long sum_sec = 0, sum_usec = 0;
-	int i, ret, count;
-	unsigned short seq_num;
-	float rtt_min = 0.0, rtt_avg = 0.0, rtt_max = 0.0;
-	float packet_loss = 100.0;
-	char addr[24];
+static void format_addr(char *addr, const struct ieee802154_addr_sa *sa)
+{
+	if (sa->addr_type == IEEE802154_ADDR_LONG)
+		print_address(addr, (uint8_t *)sa->hwaddr);
+	else
+		snprintf(addr, 24, "0x%04x", sa->short_addr);
+}
 
-	if (conf->extended)
-		print_address(addr, conf->dst.addr.hwaddr);
+static int target_cmp(const void *a, const void *b)
+{
+	const struct target *ta = a, *tb = b;
 
-	if (conf->extended)
-		fprintf(stdout, "PING %s (PAN ID 0x%04x) %i data bytes\n",
-			addr, conf->dst.addr.pan_id, conf->packet_len);
-	else
-		fprintf(stdout, "PING 0x%04x (PAN ID 0x%04x) %i data bytes\n",
-			conf->dst.addr.short_addr, conf->dst.addr.pan_id, conf->packet_len);
-	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	if (ta->key == tb->key)
+		return 0;
+	return ta->key < tb->key ? -1 : 1;
+}
 
-	/* 500ms seconds packet receive timeout */
-	timeout.tv_sec = 0;
-	timeout.tv_usec = 500000;
-	setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, (struct timeval *)&timeout,sizeof(struct timeval));
+/* Targets are sorted by key, replies are matched by their source address */
+static struct target *find_target(struct config *conf,
+				  const struct ieee802154_addr_sa *sa)
+{
+	struct target key;
 
-	count = 0;
-	for (i = 0; i < conf->packets; i++) {
-		generate_packet(buf, conf, i);
-		seq_num = (buf[2] << 8)| buf[3];
-		ret = sendto(sd, buf, conf->packet_len, 0, (struct sockaddr *)&conf->dst, sizeof(conf->dst));
-		if (ret < 0) {
-			perror("sendto");
-		}
-		gettimeofday(&start_time, NULL);
-		ret = recv(sd, buf, conf->packet_len, 0);
-		if (seq_num != ((buf[2] << 8)| buf[3])) {
-			printf("Sequenze number did not match\n");
-			continue;
-		}
-		if (ret > 0) {
-			gettimeofday(&end_time, NULL);
-			count++;
-			sec = end_time.tv_sec - start_time.tv_sec;
-			sum_sec += sec;
-			usec = end_time.tv_usec - start_time.tv_usec;
-			if (usec < 0) {
-				usec += 1000000;
-				sec--;
-				sum_sec--;
-			}
-
-			sum_usec += usec;
-			if (sec > sec_max)
-				sec_max = sec;
-			else if (sec < sec_min)
-				sec_min = sec;
-			if (usec > usec_max)
-				usec_max = usec;
-			else if (usec < usec_min)
-				usec_min = usec;
-			if (sec > 0)
-				fprintf(stdout, "Warning: packet return time over a second!\n");
-
-			if (conf->extended)
-				fprintf(stdout, "%i bytes from %s seq=%i time=%.1f ms\n", ret,
-					addr, (int)seq_num, (float)usec/1000);
-			else
-				fprintf(stdout, "%i bytes from 0x%04x seq=%i time=%.1f ms\n", ret,
-					conf->dst.addr.short_addr, (int)seq_num, (float)usec/1000);
-		} else
-			fprintf(stderr, "Hit 500 ms packet timeout\n");
-	}
+	key.key = addr_key(sa);
+	return bsearch(&key, conf->targets, conf->num_targets,
+		       sizeof(*conf->targets), target_cmp);
+}
 
-	if (count)
-		packet_loss = 100 - ((100 * count)/conf->packets);
+static int add_target(struct config *conf, struct sockaddr_ieee802154 *sa)
+{
+	struct target *targets, *t;
 
-	if (usec_min)
-		rtt_min = (float)usec_min/1000;
-	if (sum_usec && count)
-		rtt_avg = ((float)sum_usec/(float)count)/1000;
-	if (usec_max)
-		rtt_max = (float)usec_max/1000;
+	if (!(conf->num_targets % 64)) {
+		targets = realloc(conf->targets,
+				  (conf->num_targets + 64) * sizeof(*targets));
+		if (!targets)
+			return -ENOMEM;
+		conf->targets = targets;
+	}
 
-	if (conf->extended)
-		fprintf(stdout, "\n--- %s ping statistics ---\n", addr);
-	else
-		fprintf(stdout, "\n--- 0x%04x ping statistics ---\n", conf->dst.addr.short_addr);
-	fprintf(stdout, "%i packets transmitted, %i received, %.0f%% packet loss\n",
-		conf->packets, count, packet_loss);
-	fprintf(stdout, "rtt min/avg/max = %.3f/%.3f/%.3f ms\n", rtt_min, rtt_avg, rtt_max);
+	t = &conf->targets[conf->num_targets++];
+	memset(t, 0, sizeof(*t));
+	t->addr = *sa;
+	t->key = addr_key(&sa->addr);
 
-	free(buf);
 	return 0;
 }
 
-static void init_server(struct config *conf, int sd) {
-	ssize_t len;
-	unsigned char *buf;
-	struct sockaddr_ieee802154 src;
-	socklen_t addrlen;
+/* Sort the targets for find_target and drop any given more than once */
+static void unique_targets(struct config *conf)
+{
+	int i, n = 0;
 
-	addrlen = sizeof(src);
+	qsort(conf->targets, conf->num_targets, sizeof(*conf->targets), target_cmp);
+	for (i = 0; i < conf->num_targets; i++) {
+		if (n && conf->targets[n - 1].key == conf->targets[i].key)
+			continue;
+		conf->targets[n++] = conf->targets[i];
+	}
 
-	len = 0;
-	fprintf(stdout, "Server mode. Waiting for packets...\n");
-	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	if (n < conf->num_targets)
+		fprintf(stderr, "Ignoring %i duplicate destination(s).\n",
+			conf->num_targets - n);
+	conf->num_targets = n;
+}
 
-	while (1) {
-		len = recvfrom(sd, buf, MAX_PAYLOAD_LEN, 0, (struct sockaddr *)&src, &addrlen);
-		if (len < 0) {
-			perror("recvfrom");
-		}
-		//dump_packet(buf, len);
-		/* Send same packet back */
-		len = sendto(sd, buf, len, 0, (struct sockaddr *)&src, addrlen);
-		if (len < 0) {
-			perror("sendto");
-		}
-	}
-	free(buf);
+static float tv_diff_ms(const struct timeval *start, const struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0f +
+	       (end->tv_usec - start->tv_usec) / 1000.0f;
 }
 
-static int init_network(struct config *conf) {
-	int sd;
-	int ret;
+static void rto_init(struct rto_estimator *est)
+{
+	est->valid = false;
+	est->srtt = 0;
+	est->rttvar = 0;
+	est->rto = PACKET_TIMEOUT_MS;
+}
 
-	sd = socket(PF_IEEE802154, SOCK_DGRAM, 0);
-	if (sd < 0) {
-		perror("socket");
-		return 1;
-	}
+static void rto_clamp(struct rto_estimator *est)
+{
+	if (est->rto < RTO_MIN_MS)
+		est->rto = RTO_MIN_MS;
+	else if (est->rto > RTO_MAX_MS)
+		est->rto = RTO_MAX_MS;
+}
 
-	/* Bind socket on this side */
-	ret = bind(sd, (struct sockaddr *)&conf->src, sizeof(conf->src));
-	if (ret) {
-		perror("bind");
-		return 1;
+static void rto_sample(struct rto_estimator *est, float rtt)
+{
+	float err;
+
+	if (!est->valid) {
+		est->srtt = rtt;
+		est->rttvar = rtt / 2;
+		est->valid = true;
+	} else {
+		err = est->srtt - rtt;
+		if (err < 0)
+			err = -err;
+		/* beta = 1/4, alpha = 1/8 */
+		est->rttvar = 0.75f * est->rttvar + 0.25f * err;
+		est->srtt = 0.875f * est->srtt + 0.125f * rtt;
 	}
 
-	if (conf->server)
-		init_server(conf, sd);
-	else
-		measure_roundtrip(conf, sd);
+	/* K = 4 */
+	est->rto = est->srtt + 4 * est->rttvar;
+	rto_clamp(est);
+}
 
-	shutdown(sd, SHUT_RDWR);
-	close(sd);
-	return 0;
+static void rto_timeout(struct rto_estimator *est)
+{
+	/* Back off until the next valid sample */
+	est->rto *= 2;
+	rto_clamp(est);
 }
 
-static int parse_dst_addr(struct config *conf, char *arg)
+static uint64_t tv_to_us(const struct timeval *tv)
 {
-	int i;
+	return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
 
-	/* PAN ID is filled from netlink in get_interface_info */
-	conf->dst.family = AF_IEEE802154;
+/*
+ * Probe times come from CLOCK_MONOTONIC, the clock owd_now_us() stamps the
+ * server side with, so rtts and one way delays survive wall clock steps.
+ */
+static void probe_clock(struct timeval *tv)
+{
+	struct timespec ts;
 
-	if (!conf->extended) {
-		conf->dst.addr.addr_type = IEEE802154_ADDR_SHORT;
-		conf->dst.addr.short_addr = strtol(arg, NULL, 16);
-		return 0;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = ts.tv_nsec / 1000;
+}
 
-	conf->dst.addr.addr_type = IEEE802154_ADDR_LONG;
+/* Wall clock us of a probe time, the offset is taken once so a run stays steady */
+static uint64_t probe_wall_us(const struct timeval *tv)
+{
+	static int64_t offset;
+	static bool have_offset;
 
-	for (i = 0; i < IEEE802154_ADDR_LEN; i++) {
-		int temp;
-		char *cp = strchr(arg, ':');
-		if (cp) {
-			*cp = 0;
-			cp++;
-		}
-		if (sscanf(arg, "%x", &temp) != 1)
-			return -1;
-		if (temp < 0 || temp > 255)
-			return -1;
+	if (!have_offset) {
+		struct timeval wall, mono;
 
-		conf->dst.addr.hwaddr[i] = temp;
-		if (!cp)
-			break;
-		arg = cp;
+		gettimeofday(&wall, NULL);
+		probe_clock(&mono);
+		offset = (int64_t)tv_to_us(&wall) - (int64_t)tv_to_us(&mono);
+		have_offset = true;
 	}
-	if (i < IEEE802154_ADDR_LEN - 1)
-		return -1;
+	return tv_to_us(tv) + offset;
+}
 
-	return 0;
+/* Frames go into the capture under the time the engine stamped them with */
+static void capture_probe(struct transport *tr, const struct timeval *ts,
+			  const void *buf, size_t len,
+			  const struct sockaddr_ieee802154 *peer, bool inbound)
+{
+	if (tr->capture)
+		transport_capture(tr, probe_wall_us(ts), buf, len, peer, inbound);
 }
 
-int main(int argc, char *argv[]) {
-	int c, ret;
-	struct config *conf;
-	char *dst_addr;
+/* Hand a probe result to the record writer, rx may be NULL if none arrived */
+static void record_probe(struct config *conf, const struct sockaddr_ieee802154 *dst,
+			 unsigned int seq, const struct timeval *tx,
+			 const struct timeval *rx, int size, enum record_status status)
+{
+	struct probe_record r;
 
-	conf = malloc(sizeof(struct config));
+	if (!conf->recorder)
+		return;
 
-	/* Default to interface wpan0 if nothing else is given */
-	conf->interface = "wpan0";
+	r.addr = addr_key(&dst->addr);
+	r.extended = dst->addr.addr_type == IEEE802154_ADDR_LONG;
+	r.seq = seq;
+	r.tx_us = probe_wall_us(tx);
+	r.rx_us = rx ? probe_wall_us(rx) : 0;
+	r.size = size > 0 ? size : 0;
+	r.status = status;
+	record_push(conf->recorder, &r);
+}
 
-	/* Deafult to minimum packet size */
-	conf->packet_len = MIN_PAYLOAD_LEN;
+/* Receive timeout for the next probe */
+static unsigned int probe_timeout(struct config *conf)
+{
+	if (!conf->adaptive)
+		return PACKET_TIMEOUT_MS;
+	return (unsigned int)(conf->rto.rto + 0.5f);
+}
 
-	/* Default to short addressing */
-	conf->extended = false;
+static void set_rcv_timeout(int sd, unsigned int timeout_ms)
+{
+	struct timeval timeout;
 
-	if (argc < 2) {
-		usage(argv[0]);
-		exit(1);
-	}
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+	setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
 
-	while (1) {
-#ifdef HAVE_GETOPT_LONG
-		int opt_idx = -1;
-		c = getopt_long(argc, argv, "b:a:ec:s:i:dvh", perf_long_opts, &opt_idx);
-#else
-		c = getopt(argc, argv, "b:a:ec:s:i:dvh");
-#endif
-		if (c == -1)
-			break;
-		switch(c) {
-		case 'a':
-			dst_addr = optarg;
-			break;
-		case 'e':
-			conf->extended = true;
-			break;
-		case 'd':
-			conf->server = true;
-			break;
-		case 'c':
-			conf->packets = atoi(optarg);
-			break;
-		case 's':
-			conf->packet_len = atoi(optarg);
-			if (conf->packet_len >= MAX_PAYLOAD_LEN || conf->packet_len < MIN_PAYLOAD_LEN) {
-				printf("Packet size must be between %i and %i.\n",
-				       MIN_PAYLOAD_LEN, MAX_PAYLOAD_LEN - 1);
-				return 1;
-			}
-			break;
-		case 'i':
-			conf->interface = optarg;
-			break;
-		case 'v':
-			fprintf(stdout, "wpan-ping 0.1\n");
-			return 1;
-		case 'h':
-			usage(argv[0]);
-			return 1;
-		default:
-			usage(argv[0]);
-			return 1;
-		}
-	}
+/* Sleep until interval_ms have passed since start */
+static void wait_interval(const struct timeval *start, unsigned int interval_ms)
+{
+	struct timeval now;
+	struct timespec ts;
+	float left;
 
-	get_interface_info(conf);
+	if (!interval_ms)
+		return;
 
-	if (!conf->server) {
-		ret = parse_dst_addr(conf, dst_addr);
-		if (ret< 0) {
-			fprintf(stderr, "Address given in wrong format.\n");
-			return 1;
-		}
-	}
-	init_network(conf);
-	free(conf);
-	return 0;
+	probe_clock(&now);
+	left = interval_ms - tv_diff_ms(start, &now);
+	if (left <= 0)
+		return;
+
+	ts.tv_sec = (time_t)(left / 1000);
+	ts.tv_nsec = (long)((left - ts.tv_sec * 1000.0f) * 1000000.0f);
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+static bool deadline_reached(struct config *conf, const struct timeval *start)
+{
+	struct timeval now;
+
+	if (!conf->deadline_s)
+		return false;
+
+	probe_clock(&now);
+	return tv_diff_ms(start, &now) >= conf->deadline_s * 1000.0f;
+}
+
+static int print_target_table(struct config *conf)
+{
+	struct target *t;
+	char addr[24];
+	int i, alive = 0;
+
+	fprintf(stdout, "\n%-24s %6s %6s %6s  %s\n", "address", "sent", "recv",
+		"loss", "rtt min/avg/max ms");
+	for (i = 0; i < conf->num_targets; i++) {
+		t = &conf->targets[i];
+		format_addr(addr, &t->addr.addr);
+		if (t->received)
+			alive++;
+		fprintf(stdout, "%-24s %6u %6u %5.0f%%", addr, t->sent, t->received,
+			t->sent ? 100.0f - (100.0f * t->received) / t->sent : 0.0f);
+		if (t->received)
+			fprintf(stdout, "  %.3f/%.3f/%.3f\n", t->rtt_min,
+				t->rtt_sum / t->received, t->rtt_max);
+		else
+			fprintf(stdout, "  -\n");
+	}
+	return alive;
+}
+
+static void print_sweep_stats(struct config *conf)
+{
+	int alive = print_target_table(conf);
+
+	fprintf(stdout, "\n%i of %i targets alive\n", alive, conf->num_targets);
+}
+
+/*
+ * Send one probe to every target, then collect the replies of the whole
+ * round from the same socket until all answered or the timeout expired.
+ */
+static int sweep_targets(struct config *conf, struct transport *tr)
+{
+	struct sockaddr_ieee802154 src;
+	struct timeval now, next_tx, round_start, run_start;
+	struct pollfd pfd;
+	struct target *t;
+	unsigned char *buf;
+	unsigned int round, rounds;
+	int i, ret, pending, next, oldest, timeout_ms;
+	float rtt, left, wait_ms;
+	bool lost;
+
+	qsort(conf->targets, conf->num_targets, sizeof(*conf->targets), target_cmp);
+	for (i = 0; i < conf->num_targets; i++)
+		conf->targets[i].addr.addr.pan_id = conf->dst.addr.pan_id;
+
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	if (!buf)
+		return -ENOMEM;
+
+	rounds = conf->packets || conf->deadline_s ? conf->packets : 1;
+	fprintf(stdout, "SWEEP %i targets (PAN ID 0x%04x) %u data bytes, %u round(s)\n",
+		conf->num_targets, conf->dst.addr.pan_id, conf->packet_len, rounds);
+
+	pfd.fd = tr->fd;
+	pfd.events = POLLIN;
+
+	probe_clock(&run_start);
+	for (round = 0; round < rounds || (!conf->packets && conf->deadline_s); round++) {
+		if (deadline_reached(conf, &run_start))
+			break;
+
+		/*
+		 * One probe every SWEEP_TX_GAP_MS, so a long list does not
+		 * overrun the radio's queue. Each probe has its own deadline,
+		 * as they go out in target order they also expire in it.
+		 */
+		probe_clock(&round_start);
+		next_tx = round_start;
+		timeout_ms = probe_timeout(conf);
+		pending = next = oldest = 0;
+		lost = false;
+		while (next < conf->num_targets || pending) {
+			probe_clock(&now);
+			if (next < conf->num_targets && tv_diff_ms(&next_tx, &now) >= 0) {
+				t = &conf->targets[next++];
+				generate_packet(buf, conf, round);
+				ret = transport_send(tr, buf, conf->packet_len, &t->addr);
+				probe_clock(&t->tx_time);
+				t->sent++;
+				t->pending = ret >= 0;
+				if (ret < 0) {
+					perror("sendto");
+					record_probe(conf, &t->addr, round, &t->tx_time, NULL,
+						     conf->packet_len, RECORD_ERROR);
+				} else {
+					capture_probe(tr, &t->tx_time, buf, conf->packet_len,
+						      &t->addr, false);
+					pending++;
+				}
+				next_tx = t->tx_time;
+				next_tx.tv_usec += SWEEP_TX_GAP_MS * 1000;
+				if (next_tx.tv_usec >= 1000000) {
+					next_tx.tv_sec++;
+					next_tx.tv_usec -= 1000000;
+				}
+				continue;
+			}
+
+			for (; oldest < next; oldest++) {
+				t = &conf->targets[oldest];
+				if (t->pending) {
+					if (tv_diff_ms(&t->tx_time, &now) < timeout_ms)
+						break;
+					t->pending = false;
+					pending--;
+					lost = true;
+					record_probe(conf, &t->addr, round, &t->tx_time, NULL,
+						     conf->packet_len, RECORD_TIMEOUT);
+				}
+			}
+
+			/* Until the next send is due or the oldest probe expires */
+			wait_ms = -1;
+			if (next < conf->num_targets)
+				wait_ms = -tv_diff_ms(&next_tx, &now);
+			if (pending) {
+				left = timeout_ms - tv_diff_ms(&conf->targets[oldest].tx_time, &now);
+				if (wait_ms < 0 || left < wait_ms)
+					wait_ms = left;
+			}
+			if (wait_ms < 0)
+				continue;
+
+			ret = poll(&pfd, 1, (int)(wait_ms + 0.999f));
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("poll");
+				break;
+			}
+			if (!ret)
+				continue;
+
+			ret = transport_recv(tr, buf, MAX_PAYLOAD_LEN, MSG_DONTWAIT, &src);
+			probe_clock(&now);
+			if (ret < 4)
+				continue;
+			capture_probe(tr, &now, buf, ret, &src, true);
+
+			t = find_target(conf, &src.addr);
+			if (!t || !t->pending || (unsigned int)((buf[2] << 8) | buf[3]) != (round & 0xffff))
+				continue;
+
+			t->pending = false;
+			pending--;
+			rtt = tv_diff_ms(&t->tx_time, &now);
+			if (!t->received || rtt < t->rtt_min)
+				t->rtt_min = rtt;
+			if (rtt > t->rtt_max)
+				t->rtt_max = rtt;
+			t->rtt_sum += rtt;
+			t->received++;
+			if (conf->adaptive)
+				rto_sample(&conf->rto, rtt);
+			record_probe(conf, &t->addr, round, &t->tx_time, &now, ret,
+				     RECORD_OK);
+		}
+		if ((pending || lost) && conf->adaptive)
+			rto_timeout(&conf->rto);
+		for (i = 0; pending && i < conf->num_targets; i++) {
+			t = &conf->targets[i];
+			if (t->pending)
+				record_probe(conf, &t->addr, round, &t->tx_time, NULL,
+					     conf->packet_len, RECORD_TIMEOUT);
+		}
+
+		wait_interval(&round_start, conf->interval_ms);
+	}
+
+	print_sweep_stats(conf);
+	free(buf);
+	return 0;
+}
+
+/* Responders become targets as they answer, kept sorted for find_target */
+static struct target *discovered_target(struct config *conf,
+					const struct sockaddr_ieee802154 *src)
+{
+	struct sockaddr_ieee802154 sa = *src;
+	struct target *t;
+
+	t = find_target(conf, &sa.addr);
+	if (t)
+		return t;
+
+	if (add_target(conf, &sa))
+		return NULL;
+	conf->targets[conf->num_targets - 1].pending = true;
+	qsort(conf->targets, conf->num_targets, sizeof(*conf->targets), target_cmp);
+	return find_target(conf, &sa.addr);
+}
+
+/*
+ * Broadcast one probe per round and take every reply within the window.
+ * The probe tells the servers over how many ms to spread their replies, so
+ * they back off randomly instead of all answering at once.
+ */
+static int discover(struct config *conf, struct transport *tr)
+{
+	struct sockaddr_ieee802154 src;
+	struct timeval now, round_start, run_start;
+	struct pollfd pfd;
+	struct target *t;
+	unsigned char *buf;
+	unsigned int round, rounds, spread;
+	int i, ret, timeout_ms;
+	char addr[24];
+	float rtt;
+
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	if (!buf)
+		return -ENOMEM;
+
+	rounds = conf->packets ? conf->packets : DISCOVER_ROUNDS;
+	/* Replies spread over the first half, the rest leaves room for airtime */
+	spread = conf->discover_ms / 2;
+	if (spread > 0xffff)
+		spread = 0xffff;
+
+	fprintf(stdout, "DISCOVER broadcast (PAN ID 0x%04x) %u data bytes, %u round(s), "
+		"%u ms window\n", conf->dst.addr.pan_id, conf->packet_len, rounds,
+		conf->discover_ms);
+
+	pfd.fd = tr->fd;
+	pfd.events = POLLIN;
+
+	probe_clock(&run_start);
+	for (round = 0; round < rounds; round++) {
+		if (deadline_reached(conf, &run_start))
+			break;
+
+		for (i = 0; i < conf->num_targets; i++)
+			conf->targets[i].pending = true;
+
+		generate_packet(buf, conf, round);
+		buf[DISCOVER_MAGIC_OFFSET] = DISCOVER_MAGIC;
+		buf[DISCOVER_SPREAD_OFFSET] = spread >> 8;
+		buf[DISCOVER_SPREAD_OFFSET + 1] = spread & 0xff;
+		probe_clock(&round_start);
+		if (transport_send(tr, buf, conf->packet_len, &conf->dst) < 0) {
+			perror("sendto");
+			break;
+		}
+		capture_probe(tr, &round_start, buf, conf->packet_len, &conf->dst,
+			      false);
+
+		while (1) {
+			probe_clock(&now);
+			timeout_ms = conf->discover_ms - tv_diff_ms(&round_start, &now);
+			if (timeout_ms <= 0)
+				break;
+
+			ret = poll(&pfd, 1, timeout_ms);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				perror("poll");
+				break;
+			}
+			if (!ret)
+				break;
+
+			ret = transport_recv(tr, buf, MAX_PAYLOAD_LEN, MSG_DONTWAIT, &src);
+			probe_clock(&now);
+			if (ret > 0)
+				capture_probe(tr, &now, buf, ret, &src, true);
+			if (ret < MIN_PAYLOAD_LEN || packet_seq(buf, ret) != round)
+				continue;
+
+			t = discovered_target(conf, &src);
+			if (!t || !t->pending)
+				continue;
+
+			t->pending = false;
+			rtt = tv_diff_ms(&round_start, &now);
+			if (!t->received || rtt < t->rtt_min)
+				t->rtt_min = rtt;
+			if (rtt > t->rtt_max)
+				t->rtt_max = rtt;
+			t->rtt_sum += rtt;
+			t->received++;
+			record_probe(conf, &t->addr, round, &round_start, &now, ret,
+				     RECORD_OK);
+			if (!conf->quiet) {
+				format_addr(addr, &t->addr.addr);
+				fprintf(stdout, "%i bytes from %s seq=%u time=%.1f ms\n",
+					ret, addr, round, rtt);
+			}
+		}
+
+		wait_interval(&round_start, conf->interval_ms);
+	}
+
+	for (i = 0; i < conf->num_targets; i++)
+		conf->targets[i].sent = round;
+	print_target_table(conf);
+	fprintf(stdout, "\n%i responder(s) on PAN 0x%04x\n", conf->num_targets,
+		conf->dst.addr.pan_id);
+	free(buf);
+	return 0;
+}
+
+static const char *link_state_names[] = {
+	[LINK_UNKNOWN] = "unknown",
+	[LINK_UP] = "up",
+	[LINK_DOWN] = "down",
+};
+
+static void monitor_signal(int sig)
+{
+	if (sig == SIGUSR1)
+		monitor_report = 1;
+	else
+		monitor_stop = 1;
+}
+
+/* One probe to one neighbor, true and its rtt if it answered in time */
+static bool monitor_probe(struct config *conf, struct transport *tr,
+			  unsigned char *buf, struct target *t, unsigned int seq,
+			  float *rtt)
+{
+	struct sockaddr_ieee802154 src;
+	struct timeval now;
+	struct pollfd pfd;
+	int ret, timeout_ms;
+
+	pfd.fd = tr->fd;
+	pfd.events = POLLIN;
+
+	generate_packet(buf, conf, seq);
+	probe_clock(&t->tx_time);
+	if (transport_send(tr, buf, conf->packet_len, &t->addr) < 0) {
+		perror("sendto");
+		record_probe(conf, &t->addr, seq, &t->tx_time, NULL, conf->packet_len,
+			     RECORD_ERROR);
+		return false;
+	}
+	capture_probe(tr, &t->tx_time, buf, conf->packet_len, &t->addr, false);
+
+	while (!monitor_stop) {
+		probe_clock(&now);
+		timeout_ms = probe_timeout(conf) - tv_diff_ms(&t->tx_time, &now);
+		if (timeout_ms <= 0)
+			break;
+
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+
+		ret = transport_recv(tr, buf, MAX_PAYLOAD_LEN, MSG_DONTWAIT, &src);
+		probe_clock(&now);
+		if (ret > 0)
+			capture_probe(tr, &now, buf, ret, &src, true);
+		/* Late replies to earlier probes are dropped here */
+		if (ret < MIN_PAYLOAD_LEN || addr_key(&src.addr) != t->key ||
+		    packet_seq(buf, ret) != (packet_wide_seq(buf, ret) ? seq : seq & 0xffff))
+			continue;
+
+		*rtt = tv_diff_ms(&t->tx_time, &now);
+		record_probe(conf, &t->addr, seq, &t->tx_time, &now, ret, RECORD_OK);
+		return true;
+	}
+
+	record_probe(conf, &t->addr, seq, &t->tx_time, NULL, conf->packet_len,
+		     RECORD_TIMEOUT);
+	return false;
+}
+
+static void format_time(char *buf, size_t len, time_t t)
+{
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+}
+
+/*
+ * Fold one probe into the EWMAs. A neighbor only goes down after several
+ * lost probes in a row and only comes back after several replies in a row,
+ * so a single lost frame does not flap its state. Returns true on a change.
+ */
+static bool monitor_update(struct neighbor *n, bool ok, float rtt, time_t now)
+{
+	enum link_state state = n->state;
+
+	n->loss += ((ok ? 0.0f : 100.0f) - n->loss) *
+		   (n->sent ? MONITOR_LOSS_GAIN : 1.0f);
+	n->sent++;
+	if (ok) {
+		n->rtt += (rtt - n->rtt) * (n->received ? MONITOR_RTT_GAIN : 1.0f);
+		n->received++;
+		n->last_seen = now;
+		n->ok_run++;
+		n->lost_run = 0;
+		if (n->ok_run >= MONITOR_UP_AFTER)
+			state = LINK_UP;
+	} else {
+		n->lost_run++;
+		n->ok_run = 0;
+		if (n->lost_run >= MONITOR_DOWN_AFTER)
+			state = LINK_DOWN;
+	}
+
+	if (state == n->state)
+		return false;
+	n->state = state;
+	n->since = now;
+	return true;
+}
+
+static void monitor_event(struct target *t, struct neighbor *n)
+{
+	char addr[24], when[32];
+
+	format_addr(addr, &t->addr.addr);
+	format_time(when, sizeof(when), n->since);
+	fprintf(stdout, "%s %s %s rtt=%.1f ms loss=%.1f%%\n", when, addr,
+		link_state_names[n->state], n->rtt, n->loss);
+	fflush(stdout);
+}
+
+static void print_monitor_table(FILE *f, struct config *conf, struct neighbor *nbrs)
+{
+	char addr[24];
+	int i;
+
+	fprintf(f, "%-24s %-7s %10s %10s %8s %6s %8s %8s\n", "address", "state",
+		"since", "last_seen", "rtt_ms", "loss", "sent", "received");
+	for (i = 0; i < conf->num_targets; i++) {
+		format_addr(addr, &conf->targets[i].addr.addr);
+		fprintf(f, "%-24s %-7s %10lld %10lld %8.2f %5.1f%% %8lu %8lu\n", addr,
+			link_state_names[nbrs[i].state], (long long)nbrs[i].since,
+			(long long)nbrs[i].last_seen, nbrs[i].rtt, nbrs[i].loss,
+			nbrs[i].sent, nbrs[i].received);
+	}
+}
+
+/* Written next to the target and renamed, readers never see half a file */
+static int write_monitor_state(struct config *conf, struct neighbor *nbrs)
+{
+	char tmp[PATH_MAX];
+	FILE *f;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", conf->monitor_path);
+	f = fopen(tmp, "w");
+	if (!f)
+		return -errno;
+
+	print_monitor_table(f, conf, nbrs);
+	if (fclose(f)) {
+		unlink(tmp);
+		return -EIO;
+	}
+	if (rename(tmp, conf->monitor_path))
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * Resident health monitor: one probe at a time, walking the destinations
+ * round robin every -t ms, so the channel load stays at one frame pair per
+ * interval however many neighbors there are.
+ */
+static int monitor(struct config *conf, struct transport *tr)
+{
+	struct timeval probe_start, run_start;
+	struct neighbor *nbrs;
+	struct sigaction sa;
+	unsigned char *buf;
+	unsigned int seq, interval_ms;
+	time_t now, last_write = 0;
+	bool changed, ok;
+	int i;
+	float rtt = 0;
+
+	if (conf->num_targets > MAX_NEIGHBORS) {
+		fprintf(stderr, "Monitor takes at most %i destinations.\n", MAX_NEIGHBORS);
+		return -EINVAL;
+	}
+
+	qsort(conf->targets, conf->num_targets, sizeof(*conf->targets), target_cmp);
+	for (i = 0; i < conf->num_targets; i++)
+		conf->targets[i].addr.addr.pan_id = conf->dst.addr.pan_id;
+
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	nbrs = calloc(conf->num_targets, sizeof(*nbrs));
+	if (!buf || !nbrs) {
+		free(buf);
+		free(nbrs);
+		return -ENOMEM;
+	}
+
+	/* No SA_RESTART, a pending poll returns and the loop notices */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = monitor_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	interval_ms = conf->interval_ms ? conf->interval_ms : MONITOR_INTERVAL_MS;
+	fprintf(stdout, "MONITOR %i neighbor(s) (PAN ID 0x%04x), one probe every %u ms%s%s\n",
+		conf->num_targets, conf->dst.addr.pan_id, interval_ms,
+		conf->monitor_path ? ", state in " : "",
+		conf->monitor_path ? conf->monitor_path : "");
+
+	time(&now);
+	for (i = 0; i < conf->num_targets; i++)
+		nbrs[i].since = now;
+
+	probe_clock(&run_start);
+	for (seq = 0, i = 0; !monitor_stop && !deadline_reached(conf, &run_start);
+	     seq++, i = (i + 1) % conf->num_targets) {
+		probe_clock(&probe_start);
+		ok = monitor_probe(conf, tr, buf, &conf->targets[i], seq, &rtt);
+		if (monitor_stop)
+			break;
+
+		time(&now);
+		changed = monitor_update(&nbrs[i], ok, rtt, now);
+		if (changed)
+			monitor_event(&conf->targets[i], &nbrs[i]);
+		if (monitor_report) {
+			monitor_report = 0;
+			print_monitor_table(stdout, conf, nbrs);
+			fflush(stdout);
+		}
+		if (conf->monitor_path &&
+		    (changed || now - last_write >= MONITOR_STATE_S)) {
+			if (write_monitor_state(conf, nbrs))
+				perror(conf->monitor_path);
+			last_write = now;
+		}
+
+		wait_interval(&probe_start, interval_ms);
+	}
+
+	if (conf->monitor_path && write_monitor_state(conf, nbrs))
+		perror(conf->monitor_path);
+	fprintf(stdout, "\n");
+	print_monitor_table(stdout, conf, nbrs);
+	free(nbrs);
+	free(buf);
+	return 0;
+}
+
+/*
+ * Spin on a non-blocking recv instead of sleeping in the kernel, the reply
+ * is picked up without a scheduler wakeup. Times out like SO_RCVTIMEO.
+ */
+static int busy_wait_reply(struct transport *tr, unsigned char *buf,
+			   unsigned int len, unsigned int timeout_ms,
+			   struct timeval *end_time)
+{
+	struct timeval start;
+	int ret;
+
+	probe_clock(&start);
+	while (1) {
+		ret = transport_recv(tr, buf, len, MSG_DONTWAIT, NULL);
+		probe_clock(end_time);
+		if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+			return ret;
+		/* Nothing blocks here, so no signal can interrupt the wait */
+		if (soak_stop || monitor_stop || radio_stop) {
+			errno = EINTR;
+			return -1;
+		}
+		if (tv_diff_ms(&start, end_time) >= timeout_ms) {
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+}
+
+/* Blocking send followed by a recv bounded by SO_RCVTIMEO */
+static int blocking_probe(struct config *conf, struct transport *tr, unsigned char *buf,
+			  struct timeval *start_time, struct timeval *end_time,
+			  bool *tx_failed)
+{
+	int ret;
+
+	if (conf->adaptive)
+		set_rcv_timeout(tr->fd, probe_timeout(conf));
+
+	ret = transport_send(tr, buf, conf->packet_len, &conf->dst);
+	probe_clock(start_time);
+	if (ret < 0) {
+		perror("sendto");
+		*tx_failed = true;
+		return 0;
+	}
+	if (conf->rt.busy)
+		return busy_wait_reply(tr, buf, conf->packet_len, probe_timeout(conf),
+				       end_time);
+
+	ret = transport_recv(tr, buf, conf->packet_len, 0, NULL);
+	if (ret > 0)
+		probe_clock(end_time);
+
+	return ret;
+}
+
+/* Another recv for the rest of the timeout, the caller restores SO_RCVTIMEO */
+static int blocking_wait_reply(struct transport *tr, unsigned char *buf,
+			       unsigned int len, unsigned int timeout_ms,
+			       struct timeval *end_time)
+{
+	int ret;
+
+	set_rcv_timeout(tr->fd, timeout_ms);
+	ret = transport_recv(tr, buf, len, 0, NULL);
+	if (ret > 0)
+		probe_clock(end_time);
+
+	return ret;
+}
+
+enum {
+	URING_SEND,
+	URING_RECV,
+	URING_TIMEOUT,
+	URING_CANCEL,
+};
+
+/*
+ * The ring failed with a chain possibly still in flight. Cancel it and reap
+ * all its completions, so the kernel is done with the buffers before they
+ * are reused. Returns err, the run cannot go on.
+ */
+static int uring_abort(struct uring *ring, int pending, int err)
+{
+	unsigned int tries = 0;
+	int cancels = 0, res;
+	uint64_t user_data;
+
+	fprintf(stderr, "io_uring: %s\n", strerror(-err));
+
+	if (!uring_prep_cancel(ring, URING_SEND, URING_CANCEL))
+		cancels++;
+	if (!uring_prep_cancel(ring, URING_RECV, URING_CANCEL))
+		cancels++;
+
+	while (pending || cancels) {
+		if (uring_reap(ring, &user_data, &res)) {
+			if (user_data == URING_CANCEL)
+				cancels--;
+			else
+				pending--;
+			continue;
+		}
+		if (uring_submit_and_wait(ring, 1) < 0 && ++tries == URING_ABORT_TRIES)
+			break;
+	}
+
+	errno = -err;
+	return err;
+}
+
+/*
+ * Reap the completions of one submitted chain. Returns the length of the
+ * reply, 0 if none arrived in time or a negative error if the ring failed.
+ */
+static int uring_complete(struct uring *ring, int pending,
+			  struct timeval *start_time, struct timeval *end_time,
+			  bool *tx_failed)
+{
+	int ret = 0, res, err;
+	uint64_t user_data;
+
+	if (start_time)
+		probe_clock(start_time);
+	err = uring_submit_and_wait(ring, 1);
+	while (pending) {
+		if (err < 0)
+			return uring_abort(ring, pending, err);
+		if (!uring_reap(ring, &user_data, &res)) {
+			err = uring_submit_and_wait(ring, 1);
+			continue;
+		}
+		pending--;
+
+		switch (user_data) {
+		case URING_SEND:
+			if (res < 0) {
+				fprintf(stderr, "sendmsg: %s\n", strerror(-res));
+				*tx_failed = true;
+			}
+			break;
+		case URING_RECV:
+			probe_clock(end_time);
+			ret = res > 0 ? res : 0;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Send, receive and timeout are submitted as one linked chain with a single
+ * syscall. The recv is cancelled by its linked timeout if no reply arrives.
+ */
+static int uring_probe(struct config *conf, struct uring *ring, int sd,
+		       unsigned char *buf, struct timeval *start_time,
+		       struct timeval *end_time, bool *tx_failed)
+{
+	struct iovec iov = {
+		.iov_base = buf,
+		.iov_len = conf->packet_len,
+	};
+	struct msghdr msg = {
+		.msg_name = &conf->dst,
+		.msg_namelen = sizeof(conf->dst),
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+	};
+
+	uring_prep_sendmsg(ring, sd, &msg, URING_SEND, true);
+	uring_prep_recv(ring, sd, buf, conf->packet_len, URING_RECV, true);
+	uring_prep_link_timeout(ring, probe_timeout(conf), URING_TIMEOUT);
+
+	return uring_complete(ring, 3, start_time, end_time, tx_failed);
+}
+
+/* One more recv for the rest of the timeout, after a reply to another probe */
+static int uring_wait_reply(struct uring *ring, int sd, unsigned char *buf,
+			    unsigned int len, unsigned int timeout_ms,
+			    struct timeval *end_time)
+{
+	uring_prep_recv(ring, sd, buf, len, URING_RECV, true);
+	uring_prep_link_timeout(ring, timeout_ms, URING_TIMEOUT);
+
+	return uring_complete(ring, 2, NULL, end_time, NULL);
+}
+
+static unsigned int rtt_hist_index(uint32_t us)
+{
+	unsigned int shift;
+
+	if (us < (1U << RTT_HIST_SUB_BITS))
+		return us;
+
+	shift = 31 - __builtin_clz(us) - RTT_HIST_SUB_BITS;
+	return ((shift + 1) << RTT_HIST_SUB_BITS) + (us >> shift) -
+	       (1U << RTT_HIST_SUB_BITS);
+}
+
+/* Middle of a bucket in ms */
+static float rtt_hist_value(unsigned int index)
+{
+	unsigned int shift = index >> RTT_HIST_SUB_BITS;
+	uint32_t low, width;
+
+	if (!shift)
+		return index / 1000.0f;
+
+	low = ((index & ((1U << RTT_HIST_SUB_BITS) - 1)) + (1U << RTT_HIST_SUB_BITS))
+	      << (shift - 1);
+	width = 1U << (shift - 1);
+	return (low + width / 2.0f) / 1000.0f;
+}
+
+/* Percentile p (0..100) of the rtts in hist, clamped to the seen range */
+static float rtt_hist_percentile(const struct rtt_hist *hist, uint64_t total,
+				 float p, float min, float max)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+	float v;
+
+	if (!total)
+		return 0;
+
+	rank = (uint64_t)(p / 100.0f * total + 0.999f);
+	for (i = 0; i < RTT_HIST_SIZE; i++) {
+		seen += hist->count[i];
+		if (seen >= rank)
+			break;
+	}
+
+	v = rtt_hist_value(i < RTT_HIST_SIZE ? i : RTT_HIST_SIZE - 1);
+	return v < min ? min : v > max ? max : v;
+}
+
+static void stats_add_rtt(struct ping_stats *st, float rtt)
+{
+	/* A wall clock step back during the probe makes the rtt negative */
+	if (rtt < 0)
+		rtt = 0;
+	if (!st->received || rtt < st->rtt_min)
+		st->rtt_min = rtt;
+	if (rtt > st->rtt_max)
+		st->rtt_max = rtt;
+	st->rtt_sum += rtt;
+	st->received++;
+	if (st->num_rtts < st->max_rtts)
+		st->rtts[st->num_rtts++] = rtt;
+	/* The histogram ends just below 2^31 us, some 35 minutes */
+	if (st->hist)
+		st->hist->count[rtt_hist_index(rtt < INT32_MAX / 1000.0f ?
+					       rtt * 1000.0f : INT32_MAX)]++;
+}
+
+static float stats_loss(const struct ping_stats *st)
+{
+	if (!st->sent)
+		return 0.0;
+	return 100.0f - (100.0f * (st->received + st->late)) / st->sent;
+}
+
+static void seq_window_sent(struct seq_window *w, uint32_t seq)
+{
+	w->sent = seq + 1;
+	w->answered[(seq % SEQ_WINDOW) / 64] &= ~(1ULL << (seq % 64));
+}
+
+/* Mark seq answered, true if it already was */
+static bool seq_window_answer(struct seq_window *w, uint32_t seq)
+{
+	uint64_t *word = &w->answered[(seq % SEQ_WINDOW) / 64];
+	uint64_t bit = 1ULL << (seq % 64);
+	bool dup = *word & bit;
+
+	*word |= bit;
+	if (!dup && (!w->answered_any || seq > w->highest)) {
+		w->highest = seq;
+		w->answered_any = true;
+	}
+	return dup;
+}
+
+/*
+ * A reply to an earlier probe than the one waited for: the first one for a
+ * probe is late, as that probe already timed out, any further ones are
+ * duplicates. Late replies behind a newer answered probe are also reordered.
+ * Replies older than the window are ignored.
+ */
+static void seq_window_classify(struct seq_window *w, struct ping_stats *st,
+				unsigned int wire_seq, const char *addr, bool quiet)
+{
+	uint16_t dist = (w->sent - 1 - wire_seq) & 0xffff;
+	uint32_t seq;
+
+	if (dist >= SEQ_WINDOW || dist >= w->sent)
+		return;
+
+	seq = w->sent - 1 - dist;
+	if (seq_window_answer(w, seq)) {
+		st->duplicates++;
+		if (!quiet)
+			fprintf(stdout, "reply from %s seq=%u (DUP!)\n", addr, wire_seq);
+		return;
+	}
+
+	st->late++;
+	if (seq < w->highest)
+		st->reordered++;
+	if (!quiet)
+		fprintf(stdout, "reply from %s seq=%u (late)\n", addr, wire_seq);
+}
+
+static void soak_signal(int sig)
+{
+	if (sig == SIGUSR1)
+		soak_report = 1;
+	else
+		soak_stop = 1;
+}
+
+static void print_soak_line(const char *what, unsigned long secs,
+			    const struct ping_stats *st, const struct rtt_hist *hist,
+			    float min, float max)
+{
+	fprintf(stdout, "+%lus %s: sent %u recv %u late %u dup %u loss %.2f%%", secs,
+		what, st->sent, st->received, st->late, st->duplicates,
+		stats_loss(st));
+	if (st->received)
+		fprintf(stdout, " rtt min/avg/max %.3f/%.3f/%.3f p50/p90/p99 %.3f/%.3f/%.3f ms",
+			min, st->rtt_sum / st->received, max,
+			rtt_hist_percentile(hist, st->received, 50, min, max),
+			rtt_hist_percentile(hist, st->received, 90, min, max),
+			rtt_hist_percentile(hist, st->received, 99, min, max));
+	fprintf(stdout, "\n");
+	fflush(stdout);
+}
+
+/*
+ * Print the interval since the last summary, or on SIGUSR1 the totals. The
+ * interval is the difference of the counters and histograms, so memory stays
+ * constant however long the run is.
+ */
+static void soak_tick(struct config *conf, const struct ping_stats *st)
+{
+	struct soak *sk = conf->soak;
+	struct ping_stats d;
+	struct timeval now;
+	unsigned int i, lo = RTT_HIST_SIZE, hi = 0;
+
+	probe_clock(&now);
+	if (soak_report) {
+		soak_report = 0;
+		print_soak_line("total", tv_diff_ms(&sk->start, &now) / 1000, st,
+				st->hist, st->rtt_min, st->rtt_max);
+	}
+
+	if (tv_diff_ms(&sk->last, &now) < conf->soak_interval_s * 1000.0f)
+		return;
+
+	memset(&d, 0, sizeof(d));
+	d.sent = st->sent - sk->snap.sent;
+	d.received = st->received - sk->snap.received;
+	d.late = st->late - sk->snap.late;
+	d.duplicates = st->duplicates - sk->snap.duplicates;
+	d.rtt_sum = st->rtt_sum - sk->snap.rtt_sum;
+	for (i = 0; i < RTT_HIST_SIZE; i++) {
+		sk->diff.count[i] = st->hist->count[i] - sk->snap_hist.count[i];
+		if (sk->diff.count[i]) {
+			lo = i < lo ? i : lo;
+			hi = i;
+		}
+	}
+
+	print_soak_line("interval", tv_diff_ms(&sk->start, &now) / 1000, &d,
+			&sk->diff, d.received ? rtt_hist_value(lo) : 0,
+			d.received ? rtt_hist_value(hi) : 0);
+
+	sk->snap = *st;
+	sk->snap_hist = *st->hist;
+	sk->last = now;
+}
+
+/* Account the reply of probe seq, sent at tx and received at rx */
+static void probe_answered(struct config *conf, struct ping_stats *st,
+			   const unsigned char *buf, int len, uint32_t seq,
+			   const struct timeval *tx, const struct timeval *rx,
+			   const char *addr)
+{
+	struct owd_result owd;
+	float rtt;
+
+	rtt = tv_diff_ms(tx, rx);
+	stats_add_rtt(st, rtt);
+	if (conf->adaptive)
+		rto_sample(&conf->rto, rtt);
+	record_probe(conf, &conf->dst, seq, tx, rx, len, RECORD_OK);
+	if (rtt >= 1000)
+		fprintf(stdout, "Warning: packet return time over a second!\n");
+
+	if (conf->timestamps &&
+	    owd_sample(&conf->owd, buf, len, tv_to_us(tx), tv_to_us(rx), &owd)) {
+		if (!conf->quiet)
+			fprintf(stdout, "%i bytes from %s seq=%u time=%.1f ms "
+				"fwd=%.1f ret=%.1f srv=%.2f ms\n", len, addr,
+				seq, rtt, owd.fwd, owd.ret, owd.proc);
+	} else if (!conf->quiet) {
+		fprintf(stdout, "%i bytes from %s seq=%u time=%.1f ms\n", len,
+			addr, seq, rtt);
+	}
+}
+
+/* The probe could not be sent, it is lost but not for lack of a reply */
+static void probe_failed(struct config *conf, uint32_t seq, const struct timeval *tx)
+{
+	record_probe(conf, &conf->dst, seq, tx, NULL, conf->packet_len, RECORD_ERROR);
+}
+
+static void probe_lost(struct config *conf, uint32_t seq, const struct timeval *tx,
+		       unsigned int timeout_ms)
+{
+	record_probe(conf, &conf->dst, seq, tx, NULL, conf->packet_len,
+		     RECORD_TIMEOUT);
+	if (!conf->quiet)
+		fprintf(stderr, "Hit %u ms packet timeout\n", timeout_ms);
+	if (conf->adaptive)
+		rto_timeout(&conf->rto);
+}
+
+/*
+ * Windowed io_uring engine: up to conf->window probes are in flight, paced by
+ * conf->interval_ms or back to back without one. URING_RECV_DEPTH receives
+ * stay posted and are re-armed as they complete, and all sends and re-armed
+ * receives of a round go out with the wait in one io_uring_enter. Timeouts
+ * are tracked per probe and expire in the order the probes were sent.
+ */
+struct uring_slot {
+	bool outstanding;
+	bool sending; /* the kernel may still read buf */
+	uint32_t seq;
+	struct timeval tx_time;
+	uint64_t deadline_us;
+	unsigned int timeout_ms;
+	struct iovec iov[2];
+	struct msghdr msg;
+	unsigned char hdr[TRANSPORT_MAX_HDR];
+	unsigned char buf[MAX_PAYLOAD_LEN];
+};
+
+struct uring_window {
+	struct uring_slot *slots;
+	unsigned char (*rx)[TRANSPORT_MAX_HDR + MAX_PAYLOAD_LEN];
+	struct seq_window seqs;
+	unsigned int posted;
+	unsigned int sending;
+	unsigned int cancels;
+	unsigned int outstanding;
+	uint32_t next; /* sequence of the next probe */
+	uint32_t oldest; /* no probe before it is outstanding */
+};
+
+#define URING_DATA(op, idx) ((uint64_t)(op) << 32 | (idx))
+
+static bool run_window_more(struct config *conf, const struct uring_window *w,
+			    const struct timeval *run_start)
+{
+	if (soak_stop || radio_stop || deadline_reached(conf, run_start))
+		return false;
+	return w->next < conf->packets ||
+	       (!conf->packets && (conf->deadline_s || conf->soak));
+}
+
+static int run_window_send(struct config *conf, struct transport *tr,
+			   struct uring *ring, struct uring_window *w,
+			   struct ping_stats *st)
+{
+	unsigned int idx = w->next % conf->window;
+	struct uring_slot *slot = &w->slots[idx];
+	size_t hdr_len = transport_hdr_len(tr);
+
+	generate_packet(slot->buf, conf, w->next);
+	slot->iov[1].iov_base = slot->buf;
+	slot->iov[1].iov_len = conf->packet_len;
+	if (hdr_len) {
+		/* The backend's header goes in front, its fd takes no address */
+		tr->ops->wrap(tr, slot->hdr, &conf->dst);
+		slot->iov[0].iov_base = slot->hdr;
+		slot->iov[0].iov_len = hdr_len;
+		slot->msg.msg_name = NULL;
+		slot->msg.msg_namelen = 0;
+		slot->msg.msg_iov = slot->iov;
+		slot->msg.msg_iovlen = 2;
+	} else {
+		slot->msg.msg_name = &conf->dst;
+		slot->msg.msg_namelen = sizeof(conf->dst);
+		slot->msg.msg_iov = &slot->iov[1];
+		slot->msg.msg_iovlen = 1;
+	}
+	if (uring_prep_sendmsg(ring, tr->fd, &slot->msg, URING_DATA(URING_SEND, idx),
+			       false))
+		return -EBUSY;
+
+	slot->seq = w->next;
+	slot->timeout_ms = probe_timeout(conf);
+	slot->outstanding = true;
+	slot->sending = true;
+	w->outstanding++;
+	w->sending++;
+	st->sent++;
+	seq_window_sent(&w->seqs, w->next);
+	w->next++;
+	return 0;
+}
+
+static void run_window_reply(struct config *conf, struct uring_window *w,
+			     struct ping_stats *st, const unsigned char *buf,
+			     int len, const struct timeval *rx_time,
+			     const char *addr)
+{
+	uint32_t mask = packet_wide_seq(buf, len) ? 0xffffffff : 0xffff;
+	uint32_t dist, seq;
+	struct uring_slot *slot;
+
+	dist = (w->next - 1 - packet_seq(buf, len)) & mask;
+	if (w->next && dist < conf->window && dist < w->next) {
+		seq = w->next - 1 - dist;
+		slot = &w->slots[seq % conf->window];
+		if (slot->outstanding && slot->seq == seq) {
+			slot->outstanding = false;
+			w->outstanding--;
+			seq_window_answer(&w->seqs, seq);
+			probe_answered(conf, st, buf, len, seq, &slot->tx_time,
+				       rx_time, addr);
+			return;
+		}
+	}
+
+	/* Its probe already timed out or was answered */
+	seq_window_classify(&w->seqs, st, (buf[2] << 8) | buf[3], addr, conf->quiet);
+}
+
+static void run_window_expire(struct config *conf, struct uring_window *w,
+			      uint64_t now_us)
+{
+	struct uring_slot *slot;
+
+	while (w->oldest != w->next) {
+		slot = &w->slots[w->oldest % conf->window];
+		if (slot->outstanding && slot->seq == w->oldest) {
+			if (slot->deadline_us > now_us)
+				break;
+			slot->outstanding = false;
+			w->outstanding--;
+			probe_lost(conf, slot->seq, &slot->tx_time, slot->timeout_ms);
+		}
+		w->oldest++;
+	}
+}
+
+static void run_window_complete(struct config *conf, struct transport *tr,
+				struct uring *ring, struct uring_window *w,
+				struct ping_stats *st, bool running,
+				const char *addr)
+{
+	int hdr_len = transport_hdr_len(tr);
+	struct timeval rx_time;
+	struct uring_slot *slot;
+	uint64_t user_data;
+	unsigned char *rx;
+	unsigned int idx;
+	int res;
+
+	probe_clock(&rx_time);
+	while (uring_reap(ring, &user_data, &res)) {
+		idx = (uint32_t)user_data;
+
+		switch (user_data >> 32) {
+		case URING_SEND:
+			slot = &w->slots[idx];
+			slot->sending = false;
+			w->sending--;
+			if (res >= 0) {
+				/* Captured once sent, the slot keeps the probe until then */
+				capture_probe(tr, &slot->tx_time, slot->buf,
+					      conf->packet_len, &conf->dst, false);
+				break;
+			}
+			fprintf(stderr, "sendmsg: %s\n", strerror(-res));
+			if (slot->outstanding && running) {
+				slot->outstanding = false;
+				w->outstanding--;
+				probe_failed(conf, slot->seq, &slot->tx_time);
+			}
+			break;
+		case URING_CANCEL:
+			w->cancels--;
+			break;
+		case URING_RECV:
+			w->posted--;
+			rx = w->rx[idx] + hdr_len;
+			if (res > hdr_len && running) {
+				capture_probe(tr, &rx_time, rx, res - hdr_len,
+					      &conf->dst, true);
+				run_window_reply(conf, w, st, rx, res - hdr_len,
+						 &rx_time, addr);
+			} else if (res < 0 && res != -ECANCELED) {
+				fprintf(stderr, "recv: %s\n", strerror(-res));
+			}
+			if (running && !uring_prep_recv(ring, tr->fd, w->rx[idx],
+						      hdr_len + MAX_PAYLOAD_LEN,
+						      URING_DATA(URING_RECV, idx), false))
+				w->posted++;
+			break;
+		}
+	}
+}
+
+/* Cancel the posted receives and wait until the kernel is done with all buffers */
+static void run_window_drain(struct config *conf, struct transport *tr,
+			     struct uring *ring, struct uring_window *w,
+			     struct ping_stats *st, const char *addr)
+{
+	unsigned int i, tries = 0;
+
+	for (i = 0; i < URING_RECV_DEPTH; i++)
+		if (!uring_prep_cancel(ring, URING_DATA(URING_RECV, i),
+				       URING_DATA(URING_CANCEL, i)))
+			w->cancels++;
+
+	while (w->posted || w->sending || w->cancels) {
+		if (uring_submit_and_wait(ring, 1) < 0 && ++tries == URING_ABORT_TRIES) {
+			fprintf(stderr, "io_uring: %u requests not reaped\n",
+				w->posted + w->sending + w->cancels);
+			break;
+		}
+		run_window_complete(conf, tr, ring, w, st, false, addr);
+	}
+}
+
+static void run_window(struct config *conf, struct transport *tr,
+		       struct uring *ring, struct ping_stats *st)
+{
+	uint64_t now_us, next_tx_us, wait_us;
+	struct timeval run_start, now;
+	struct uring_window *w;
+	struct uring_slot *slot;
+	uint32_t first, seq;
+	char addr[24];
+	unsigned int i;
+	bool more;
+	int err;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return;
+	w->slots = calloc(conf->window, sizeof(*w->slots));
+	w->rx = calloc(URING_RECV_DEPTH, sizeof(*w->rx));
+	if (!w->slots || !w->rx)
+		goto out;
+	if (conf->rt.enabled) {
+		rt_prefault(w->slots, conf->window * sizeof(*w->slots));
+		rt_prefault(w->rx, URING_RECV_DEPTH * sizeof(*w->rx));
+	}
+
+	format_addr(addr, &conf->dst.addr);
+
+	for (i = 0; i < URING_RECV_DEPTH; i++)
+		if (!uring_prep_recv(ring, tr->fd, w->rx[i],
+				     transport_hdr_len(tr) + MAX_PAYLOAD_LEN,
+				     URING_DATA(URING_RECV, i), false))
+			w->posted++;
+
+	probe_clock(&run_start);
+	next_tx_us = tv_to_us(&run_start);
+	while (1) {
+		probe_clock(&now);
+		now_us = tv_to_us(&now);
+		if (conf->soak)
+			soak_tick(conf, st);
+		run_window_expire(conf, w, now_us);
+
+		more = run_window_more(conf, w, &run_start);
+		if (!more && (!w->outstanding || soak_stop || radio_stop))
+			break;
+
+		first = w->next;
+		while (more && next_tx_us <= now_us) {
+			slot = &w->slots[w->next % conf->window];
+			if (slot->outstanding || slot->sending ||
+			    run_window_send(conf, tr, ring, w, st))
+				break;
+			next_tx_us += conf->interval_ms * 1000ULL;
+			more = run_window_more(conf, w, &run_start);
+		}
+		/* No catching up after a stall */
+		if (next_tx_us < now_us)
+			next_tx_us = now_us;
+
+		/* Sleep until the next probe is due or the oldest one times out */
+		wait_us = PACKET_TIMEOUT_MS * 1000;
+		slot = &w->slots[w->next % conf->window];
+		if (more && !slot->outstanding && !slot->sending)
+			wait_us = next_tx_us > now_us ? next_tx_us - now_us : 0;
+
+		/* Stamp the new probes right before they are submitted */
+		probe_clock(&now);
+		now_us = tv_to_us(&now);
+		for (seq = first; seq != w->next; seq++) {
+			slot = &w->slots[seq % conf->window];
+			slot->tx_time = now;
+			slot->deadline_us = now_us + slot->timeout_ms * 1000ULL;
+		}
+		if (w->oldest != w->next) {
+			slot = &w->slots[w->oldest % conf->window];
+			if (slot->deadline_us <= now_us)
+				wait_us = 0;
+			else if (slot->deadline_us - now_us < wait_us)
+				wait_us = slot->deadline_us - now_us;
+		}
+
+		err = uring_submit_and_wait_timeout(ring, 1, wait_us);
+		if (err < 0 && err != -ETIME && err != -EINTR) {
+			fprintf(stderr, "io_uring: %s\n", strerror(-err));
+			break;
+		}
+		run_window_complete(conf, tr, ring, w, st, true, addr);
+	}
+
+	/* Stopped or failed with probes in flight, these do not count */
+	st->sent -= w->outstanding;
+	run_window_drain(conf, tr, ring, w, st, addr);
+
+out:
+	free(w->slots);
+	free(w->rx);
+	free(w);
+}
+
+/*
+ * Run conf->packets probes of conf->packet_len against conf->dst, stop-and-wait
+ * unless the io_uring engine keeps a window of them in flight
+ */
+static void run_probes(struct config *conf, struct transport *tr, struct uring *ring,
+		       unsigned char *buf, struct ping_stats *st)
+{
+	struct timeval start_time, end_time, probe_start, run_start;
+	struct timeval now;
+	unsigned char sent[MAX_PAYLOAD_LEN];
+	struct seq_window *win;
+	unsigned int timeout_ms;
+	uint32_t i, seq_num;
+	char addr[24];
+	bool rearm, interrupted, tx_failed;
+	float left;
+	int ret;
+
+	if (ring && conf->window > 1) {
+		run_window(conf, tr, ring, st);
+		return;
+	}
+
+	win = calloc(1, sizeof(*win));
+	if (!win)
+		return;
+
+	format_addr(addr, &conf->dst.addr);
+
+	probe_clock(&run_start);
+	for (i = 0; i < conf->packets ||
+		    (!conf->packets && (conf->deadline_s || conf->soak)); i++) {
+		if (deadline_reached(conf, &run_start) || soak_stop || radio_stop)
+			break;
+		if (conf->soak)
+			soak_tick(conf, st);
+
+		probe_clock(&probe_start);
+		timeout_ms = probe_timeout(conf);
+		generate_packet(buf, conf, i);
+		seq_num = packet_seq(buf, conf->packet_len);
+		seq_window_sent(win, i);
+		st->sent++;
+		tx_failed = false;
+		/* The reply overwrites buf, the probe is captured from a copy */
+		if (tr->capture)
+			memcpy(sent, buf, conf->packet_len);
+		if (ring)
+			ret = uring_probe(conf, ring, tr->fd, buf, &start_time, &end_time,
+					  &tx_failed);
+		else
+			ret = blocking_probe(conf, tr, buf, &start_time, &end_time,
+					     &tx_failed);
+		if (!tx_failed && (!ring || ret >= 0))
+			capture_probe(tr, &start_time, sent, conf->packet_len,
+				      &conf->dst, false);
+		if (ret > 0)
+			capture_probe(tr, &end_time, buf, ret, &conf->dst, true);
+
+		/*
+		 * Replies to earlier probes may arrive first, keep waiting for
+		 * ours. So do signals, the blocking recv is not restarted.
+		 */
+		rearm = false;
+		while ((ret > 0 && seq_num != packet_seq(buf, ret)) ||
+		       (ret < 0 && errno == EINTR && !soak_stop && !radio_stop)) {
+			if (ret > 0)
+				seq_window_classify(win, st, (buf[2] << 8)| buf[3],
+						    addr, conf->quiet);
+			probe_clock(&now);
+			left = timeout_ms - tv_diff_ms(&start_time, &now);
+			if (left < 1) {
+				ret = 0;
+				break;
+			}
+			if (ring) {
+				ret = uring_wait_reply(ring, tr->fd, buf, conf->packet_len,
+						       left, &end_time);
+			} else if (conf->rt.busy) {
+				ret = busy_wait_reply(tr, buf, conf->packet_len, left,
+						      &end_time);
+			} else {
+				ret = blocking_wait_reply(tr, buf, conf->packet_len,
+							  left, &end_time);
+				rearm = true;
+			}
+			if (ret > 0)
+				capture_probe(tr, &end_time, buf, ret, &conf->dst, true);
+		}
+		interrupted = ret < 0 && errno == EINTR;
+		if (rearm)
+			set_rcv_timeout(tr->fd, probe_timeout(conf));
+
+		/* Stopped while waiting, this probe does not count */
+		if (interrupted && (soak_stop || radio_stop)) {
+			st->sent--;
+			break;
+		}
+		/* The ring failed, the chain is cancelled and so is the run */
+		if (ring && ret < 0) {
+			st->sent--;
+			break;
+		}
+
+		if (ret > 0) {
+			seq_window_answer(win, i);
+			probe_answered(conf, st, buf, ret, seq_num, &start_time,
+				       &end_time, addr);
+		} else if (tx_failed) {
+			probe_failed(conf, seq_num, &start_time);
+		} else {
+			probe_lost(conf, seq_num, &start_time, timeout_ms);
+		}
+
+		wait_interval(&probe_start, conf->interval_ms);
+	}
+
+	free(win);
+}
+
+static struct uring *client_uring(struct config *conf)
+{
+	struct uring *ring;
+
+	if (!conf->uring)
+		return NULL;
+
+	/*
+	 * The chain sends ieee802154 addresses straight to the socket, only
+	 * the window frames datagrams for other backends
+	 */
+	if (!transport_native(conf->transport) &&
+	    (!conf->transport->ops->wrap || conf->window < 2)) {
+		fprintf(stderr, "io_uring needs the %s transport%s, using %s\n",
+			ieee802154_transport.name,
+			conf->transport->ops->wrap ? " or a window (-N)" : "",
+			conf->transport->ops->name);
+		return NULL;
+	}
+
+	/*
+	 * One send, recv and link timeout in flight per probe plus room for
+	 * cancelling them, or a window of sends with the posted receives
+	 */
+	ring = uring_new(conf->window > 1 ?
+			 conf->window + 2 * URING_RECV_DEPTH : 8);
+	if (!ring)
+		fprintf(stderr, "io_uring not available (%s), using blocking sockets\n",
+			strerror(errno));
+	return ring;
+}
+
+static void print_owd_stats(const struct owd_estimator *est)
+{
+	if (!est->fwd.count) {
+		fprintf(stdout, "no server timestamps, the server needs timestamp support\n");
+		return;
+	}
+
+	fprintf(stdout, "forward min/avg/max = %.3f/%.3f/%.3f ms\n", est->fwd.min,
+		est->fwd.sum / est->fwd.count, est->fwd.max);
+	fprintf(stdout, "return min/avg/max = %.3f/%.3f/%.3f ms\n", est->ret.min,
+		est->ret.sum / est->ret.count, est->ret.max);
+	fprintf(stdout, "server min/avg/max = %.3f/%.3f/%.3f ms\n", est->proc.min,
+		est->proc.sum / est->proc.count, est->proc.max);
+	fprintf(stdout, "clock offset %lld us, drift %.2f ppm\n",
+		(long long)est->offset, est->drift);
+}
+
+/* Endless or -w bounded run with interval summaries, SIGINT ends, SIGUSR1 reports */
+static void soak_start(struct config *conf, struct ping_stats *st)
+{
+	struct sigaction sa;
+
+	st->hist = calloc(1, sizeof(*st->hist));
+	conf->soak = calloc(1, sizeof(*conf->soak));
+	if (!st->hist || !conf->soak) {
+		free(st->hist);
+		st->hist = NULL;
+		return;
+	}
+
+	probe_clock(&conf->soak->start);
+	conf->soak->last = conf->soak->start;
+
+	/* No SA_RESTART, a pending recv returns and the loop notices */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = soak_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	fprintf(stdout, "soak: summary every %u s, SIGUSR1 for totals, SIGINT to stop\n",
+		conf->soak_interval_s);
+}
+
+static int measure_roundtrip(struct config *conf, struct transport *tr) {
+	struct ping_stats st;
+	unsigned char *buf;
+	char addr[24];
+	struct uring *ring;
+
+	format_addr(addr, &conf->dst.addr);
+	ring = client_uring(conf);
+
+	fprintf(stdout, "PING %s (PAN ID 0x%04x) %u data bytes\n",
+		addr, conf->dst.addr.pan_id, conf->packet_len);
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	if (conf->rt.enabled)
+		rt_prefault(buf, MAX_PAYLOAD_LEN);
+
+	/* Packet receive timeout for the blocking path */
+	set_rcv_timeout(tr->fd, PACKET_TIMEOUT_MS);
+
+	memset(&st, 0, sizeof(st));
+	if (conf->soak_interval_s)
+		soak_start(conf, &st);
+
+	run_probes(conf, tr, ring, buf, &st);
+
+	fprintf(stdout, "\n--- %s ping statistics ---\n", addr);
+	fprintf(stdout, "%u packets transmitted, %u received, %.0f%% packet loss\n",
+		st.sent, st.received, stats_loss(&st));
+	fprintf(stdout, "late/duplicate/reordered = %u/%u/%u\n", st.late,
+		st.duplicates, st.reordered);
+	fprintf(stdout, "rtt min/avg/max = %.3f/%.3f/%.3f ms\n", st.rtt_min,
+		st.received ? st.rtt_sum / st.received : 0.0f, st.rtt_max);
+	if (st.hist && st.received)
+		fprintf(stdout, "rtt p50/p90/p99 = %.3f/%.3f/%.3f ms\n",
+			rtt_hist_percentile(st.hist, st.received, 50, st.rtt_min, st.rtt_max),
+			rtt_hist_percentile(st.hist, st.received, 90, st.rtt_min, st.rtt_max),
+			rtt_hist_percentile(st.hist, st.received, 99, st.rtt_min, st.rtt_max));
+	if (conf->adaptive)
+		fprintf(stdout, "srtt/rttvar/rto = %.3f/%.3f/%.3f ms\n",
+			conf->rto.srtt, conf->rto.rttvar, conf->rto.rto);
+	if (conf->timestamps)
+		print_owd_stats(&conf->owd);
+
+	uring_free(ring);
+	free(st.hist);
+	free(conf->soak);
+	conf->soak = NULL;
+	free(buf);
+	return 0;
+}
+
+/* Whether a payload of size bytes makes it to the peer and back */
+static bool mtu_probe_size(struct config *conf, struct transport *tr, struct uring *ring,
+			   unsigned char *buf, unsigned int size)
+{
+	struct ping_stats st;
+	unsigned int packets = conf->packets;
+	bool quiet = conf->quiet;
+
+	conf->packet_len = size;
+	conf->packets = MTU_PROBE_TRIES;
+	conf->quiet = true;
+
+	memset(&st, 0, sizeof(st));
+	run_probes(conf, tr, ring, buf, &st);
+
+	conf->packets = packets;
+	conf->quiet = quiet;
+	return st.received > 0;
+}
+
+/*
+ * Binary search the largest payload which is echoed back. Larger frames
+ * than the peer or any hop supports are simply never answered.
+ */
+static int probe_mtu(struct config *conf, struct transport *tr)
+{
+	unsigned char *buf;
+	char addr[24];
+	struct uring *ring;
+	unsigned int lo = MIN_PAYLOAD_LEN, hi = conf->max_payload, mid;
+	bool ok;
+
+	format_addr(addr, &conf->dst.addr);
+	ring = client_uring(conf);
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	set_rcv_timeout(tr->fd, PACKET_TIMEOUT_MS);
+
+	fprintf(stdout, "MTU PROBE %s (PAN ID 0x%04x) %u..%u data bytes\n",
+		addr, conf->dst.addr.pan_id, lo, hi);
+
+	if (!mtu_probe_size(conf, tr, ring, buf, lo)) {
+		fprintf(stdout, "no reply to %u byte probes, giving up\n", lo);
+		goto out;
+	}
+
+	/* lo is known to work, everything above hi is known to fail */
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		ok = mtu_probe_size(conf, tr, ring, buf, mid);
+		fprintf(stdout, "%5u bytes: %s\n", mid, ok ? "ok" : "no reply");
+		if (ok)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	fprintf(stdout, "\nmax payload %u bytes, frame %u bytes\n", lo, lo +
+		(conf->extended ? EXTENDED_FRAME_OVERHEAD : SHORT_FRAME_OVERHEAD));
+out:
+	uring_free(ring);
+	free(buf);
+	return 0;
+}
+
+/*
+ * Run the probe engine once per payload size. A least squares fit of the
+ * average rtt over the size splits it into a fixed per frame part and a
+ * per byte part, each covering both directions of the echo.
+ */
+static int sweep_sizes(struct config *conf, struct transport *tr)
+{
+	struct ping_stats st;
+	struct timeval start, end;
+	unsigned char *buf;
+	char addr[24];
+	struct uring *ring;
+	unsigned int size;
+	double x, y, n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+	double per_byte, fixed;
+	float avg, elapsed;
+	bool quiet = conf->quiet;
+
+	format_addr(addr, &conf->dst.addr);
+	ring = client_uring(conf);
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+
+	/* Without count or deadline every size gets a small default burst */
+	if (!conf->packets && !conf->deadline_s)
+		conf->packets = SWEEP_SIZE_PACKETS;
+
+	set_rcv_timeout(tr->fd, PACKET_TIMEOUT_MS);
+
+	fprintf(stdout, "SIZE SWEEP %s (PAN ID 0x%04x) %u..%u data bytes, step %u\n",
+		addr, conf->dst.addr.pan_id, conf->size_min, conf->size_max,
+		conf->size_step);
+	fprintf(stdout, "\n%6s %6s %6s %6s  %-26s %12s\n", "size", "sent", "recv",
+		"loss", "rtt min/avg/max ms", "goodput kbps");
+
+	/* Reply lines would end up between the rows of the table */
+	conf->quiet = true;
+	for (size = conf->size_min; size <= conf->size_max; size += conf->size_step) {
+		conf->packet_len = size;
+		memset(&st, 0, sizeof(st));
+		probe_clock(&start);
+		run_probes(conf, tr, ring, buf, &st);
+		probe_clock(&end);
+		elapsed = tv_diff_ms(&start, &end);
+
+		fprintf(stdout, "%6u %6u %6u %5.0f%%", size, st.sent, st.received,
+			stats_loss(&st));
+		if (!st.received) {
+			fprintf(stdout, "  -\n");
+			continue;
+		}
+
+		/* Echoed payload over the time the probes of this size took */
+		avg = st.rtt_sum / st.received;
+		fprintf(stdout, "  %8.3f/%8.3f/%8.3f %12.2f\n", st.rtt_min, avg,
+			st.rtt_max, st.received * size * 8 / elapsed);
+
+		x = size;
+		y = avg;
+		n++;
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+
+	conf->quiet = quiet;
+
+	if (n >= 2 && n * sxx - sx * sx > 0) {
+		per_byte = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+		fixed = (sy - per_byte * sx) / n;
+		fprintf(stdout, "\nper byte airtime: %.2f us one way (%.2f us round trip)\n",
+			per_byte * 500, per_byte * 1000);
+		fprintf(stdout, "fixed per frame overhead: %.3f ms one way (%.3f ms round trip)\n",
+			fixed / 2, fixed);
+	} else {
+		fprintf(stdout, "\nnot enough sizes answered to fit the airtime model\n");
+	}
+
+	uring_free(ring);
+	free(buf);
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	size_t offset;
+} mac_fields[] = {
+	{ "max_be", offsetof(struct mac_params, max_be) },
+	{ "min_be", offsetof(struct mac_params, min_be) },
+	{ "csma_backoffs", offsetof(struct mac_params, csma_backoffs) },
+	{ "frame_retries", offsetof(struct mac_params, frame_retries) },
+};
+
+static int *mac_field(struct mac_params *mac, int i)
+{
+	return (int *)((char *)mac + mac_fields[i].offset);
+}
+
+/*
+ * Runs that change radio settings stop on SIGINT or SIGTERM and put the
+ * original ones back. No SA_RESTART, a pending recv returns early.
+ */
+static void radio_signal(int sig)
+{
+	radio_stop = 1;
+}
+
+static void radio_signals(struct sigaction *old_int, struct sigaction *old_term)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = radio_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, old_int);
+	sigaction(SIGTERM, &sa, old_term);
+}
+
+static void radio_restore_signals(const struct sigaction *old_int,
+				  const struct sigaction *old_term)
+{
+	sigaction(SIGINT, old_int, NULL);
+	sigaction(SIGTERM, old_term, NULL);
+}
+
+/*
+ * Apply one combination and run the fixed load against it. The score is
+ * Kleinrock's power, goodput over average rtt, so neither a lossless but
+ * slow nor a fast but lossy setting wins.
+ */
+static int tune_point(struct config *conf, struct transport *tr,
+		      struct phyctl *pc, struct uring *ring, unsigned char *buf,
+		      const struct mac_params *mac, float *score)
+{
+	struct ping_stats st;
+	struct timeval start, end;
+	float elapsed, goodput = 0, avg = 0;
+
+	if (phyctl_set_mac(pc, mac))
+		return -1;
+
+	memset(&st, 0, sizeof(st));
+	probe_clock(&start);
+	run_probes(conf, tr, ring, buf, &st);
+	probe_clock(&end);
+
+	elapsed = tv_diff_ms(&start, &end);
+	*score = 0;
+	if (st.received) {
+		avg = st.rtt_sum / st.received;
+		goodput = st.received * conf->packet_len * 8 / elapsed;
+		*score = goodput / avg;
+	}
+
+	fprintf(stdout, "%6i %6i %8i %7i %6u %5.0f%% %8.3f %12.2f %8.3f\n",
+		mac->min_be, mac->max_be, mac->csma_backoffs, mac->frame_retries,
+		st.received, stats_loss(&st), avg, goodput, *score);
+	return 0;
+}
+
+/*
+ * Coordinate search over the advertised ranges: one parameter at a time is
+ * stepped through its range with the others at the best values so far,
+ * repeated while a pass still improves. The best combination stays applied.
+ */
+static int tune_mac(struct config *conf, struct transport *tr)
+{
+	struct phyctl *pc;
+	struct phy_caps caps;
+	struct mac_params orig, best, cand;
+	struct sigaction old_int, old_term;
+	struct uring *ring;
+	unsigned char *buf;
+	float best_score, score;
+	bool improved;
+	int pass, i, v, ret = -1;
+	char addr[24];
+
+	pc = phyctl_open(conf->interface);
+	if (!pc)
+		return -1;
+	if (phyctl_get_caps(pc, &caps) || phyctl_get_mac(pc, &orig))
+		goto out_pc;
+	if (!caps.max.max_be) {
+		fprintf(stderr, "%s does not advertise CSMA/retry ranges.\n",
+			conf->interface);
+		goto out_pc;
+	}
+	radio_signals(&old_int, &old_term);
+
+	if (!conf->packets && !conf->deadline_s)
+		conf->packets = TUNE_PACKETS;
+	conf->quiet = true;
+	ring = client_uring(conf);
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	set_rcv_timeout(tr->fd, PACKET_TIMEOUT_MS);
+
+	format_addr(addr, &conf->dst.addr);
+	fprintf(stdout, "TUNE %s via %s %u data bytes, %u probes per setting\n",
+		addr, conf->interface, conf->packet_len, conf->packets);
+	fprintf(stdout, "min_be %i-%i, max_be %i-%i, csma_backoffs %i-%i, frame_retries %i-%i\n",
+		caps.min.min_be, caps.max.min_be, caps.min.max_be, caps.max.max_be,
+		caps.min.csma_backoffs, caps.max.csma_backoffs,
+		caps.min.frame_retries, caps.max.frame_retries);
+	fprintf(stdout, "\n%6s %6s %8s %7s %6s %6s %8s %12s %8s\n", "min_be",
+		"max_be", "backoffs", "retries", "recv", "loss", "rtt ms",
+		"goodput kbps", "score");
+
+	best = orig;
+	if (tune_point(conf, tr, pc, ring, buf, &best, &best_score))
+		goto out;
+
+	for (pass = 0; pass < TUNE_PASSES; pass++) {
+		improved = false;
+		for (i = 0; i < (int)(sizeof(mac_fields) / sizeof(mac_fields[0])); i++) {
+			for (v = *mac_field(&caps.min, i); v <= *mac_field(&caps.max, i); v++) {
+				cand = best;
+				*mac_field(&cand, i) = v;
+				if (v == *mac_field(&best, i) || cand.min_be > cand.max_be)
+					continue;
+				if (radio_stop ||
+				    tune_point(conf, tr, pc, ring, buf, &cand, &score))
+					goto out;
+				if (score > best_score) {
+					best = cand;
+					best_score = score;
+					improved = true;
+				}
+			}
+		}
+		if (!improved)
+			break;
+	}
+	if (radio_stop)
+		goto out;
+
+	if (!best_score) {
+		fprintf(stdout, "\nno setting got a reply, restoring the original one\n");
+		best = orig;
+	}
+	if (phyctl_set_mac(pc, &best))
+		goto out;
+
+	fprintf(stdout, "\nbest: min_be %i max_be %i csma_backoffs %i frame_retries %i\n",
+		best.min_be, best.max_be, best.csma_backoffs, best.frame_retries);
+	fprintf(stdout, "iwpan dev %s set backoff_exponents %i %i\n", conf->interface,
+		best.min_be, best.max_be);
+	fprintf(stdout, "iwpan dev %s set max_csma_backoffs %i\n", conf->interface,
+		best.csma_backoffs);
+	fprintf(stdout, "iwpan dev %s set max_frame_retries %i\n", conf->interface,
+		best.frame_retries);
+	ret = 0;
+out:
+	/* Failed or interrupted, do not leave a half tried setting behind */
+	if (ret) {
+		if (radio_stop)
+			fprintf(stdout, "\ninterrupted, restoring the original setting\n");
+		if (phyctl_set_mac(pc, &orig))
+			fprintf(stderr, "Could not restore the original CSMA/retry setting.\n");
+	}
+	radio_restore_signals(&old_int, &old_term);
+	uring_free(ring);
+	free(buf);
+out_pc:
+	phyctl_close(pc);
+	return ret;
+}
+
+static int float_cmp(const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+
+	return (fa > fb) - (fa < fb);
+}
+
+static int mbm_desc_cmp(const void *a, const void *b)
+{
+	int32_t pa = *(const int32_t *)a, pb = *(const int32_t *)b;
+
+	return (pb > pa) - (pb < pa);
+}
+
+/* Nearest rank percentile, sorts the samples */
+static float stats_percentile(struct ping_stats *st, float p)
+{
+	unsigned int rank;
+
+	if (!st->num_rtts)
+		return 0;
+
+	qsort(st->rtts, st->num_rtts, sizeof(*st->rtts), float_cmp);
+	rank = (unsigned int)(p / 100.0f * st->num_rtts + 0.999f);
+	return st->rtts[rank ? rank - 1 : 0];
+}
+
+/*
+ * Walk the advertised tx powers from the highest down and run a burst per
+ * destination at each. A destination drops out at the first level where it
+ * misses the loss or p99 limit; its minimum is the level before. The sweep
+ * ends when all dropped out and leaves the highest of these minimums set.
+ */
+static int power_sweep(struct config *conf, struct transport *tr)
+{
+	struct sockaddr_ieee802154 single = conf->dst;
+	struct sockaddr_ieee802154 *dsts[MAX_TARGETS_POWER];
+	int32_t min_mbm[MAX_TARGETS_POWER];
+	struct phyctl *pc;
+	struct phy_caps caps;
+	struct ping_stats st;
+	struct sigaction old_int, old_term;
+	struct rtt_hist *hist = NULL;
+	struct uring *ring;
+	unsigned char *buf;
+	float *rtts = NULL, p99;
+	int32_t orig, need;
+	int i, l, num, alive, met, ret = -1;
+	bool ok;
+	char addr[24];
+
+	num = conf->num_targets ? conf->num_targets : 1;
+	if (num > MAX_TARGETS_POWER) {
+		fprintf(stderr, "At most %i destinations per power sweep.\n",
+			MAX_TARGETS_POWER);
+		return -1;
+	}
+	for (i = 0; i < num; i++) {
+		dsts[i] = conf->num_targets ? &conf->targets[i].addr : &single;
+		dsts[i]->addr.pan_id = conf->dst.addr.pan_id;
+		min_mbm[i] = INT32_MIN;
+	}
+
+	pc = phyctl_open(conf->interface);
+	if (!pc)
+		return -1;
+	if (phyctl_get_caps(pc, &caps) || phyctl_get_tx_power(pc, &orig))
+		goto out_pc;
+	if (!caps.num_tx_powers) {
+		fprintf(stderr, "%s does not advertise tx power levels.\n",
+			conf->interface);
+		goto out_pc;
+	}
+	qsort(caps.tx_powers, caps.num_tx_powers, sizeof(caps.tx_powers[0]),
+	      mbm_desc_cmp);
+
+	if (!conf->packets && !conf->deadline_s)
+		conf->packets = POWER_PACKETS;
+	conf->quiet = true;
+	radio_signals(&old_int, &old_term);
+	ring = client_uring(conf);
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	/* Exact percentiles for a known count, the histogram for -w bursts */
+	if (conf->packets)
+		rtts = calloc(conf->packets, sizeof(*rtts));
+	else
+		hist = malloc(sizeof(*hist));
+	if (!buf || (!rtts && !hist))
+		goto out;
+	set_rcv_timeout(tr->fd, PACKET_TIMEOUT_MS);
+
+	fprintf(stdout, "POWER SWEEP via %s %u data bytes, %i levels from %.3g dBm, "
+		"loss <= %.1f%%, p99 <= %.1f ms\n", conf->interface,
+		conf->packet_len, caps.num_tx_powers, caps.tx_powers[0] / 100.0f,
+		conf->power_max_loss, conf->power_max_p99);
+	fprintf(stdout, "\n%7s %-24s %6s %6s %6s %9s %9s\n", "dBm", "address",
+		"sent", "recv", "loss", "avg ms", "p99 ms");
+
+	alive = num;
+	for (l = 0; l < caps.num_tx_powers && alive && !radio_stop; l++) {
+		if (phyctl_set_tx_power(pc, caps.tx_powers[l]))
+			goto out;
+
+		for (i = 0; i < num; i++) {
+			/* Only destinations which met the limits one level up */
+			if (l && min_mbm[i] != caps.tx_powers[l - 1])
+				continue;
+
+			memset(&st, 0, sizeof(st));
+			st.rtts = rtts;
+			st.max_rtts = rtts ? conf->packets : 0;
+			if (hist) {
+				memset(hist, 0, sizeof(*hist));
+				st.hist = hist;
+			}
+			conf->dst = *dsts[i];
+			run_probes(conf, tr, ring, buf, &st);
+			if (radio_stop)
+				goto out;
+
+			if (hist)
+				p99 = rtt_hist_percentile(hist, st.received, 99,
+							  st.rtt_min, st.rtt_max);
+			else
+				p99 = stats_percentile(&st, 99);
+			ok = st.received && stats_loss(&st) <= conf->power_max_loss &&
+			     p99 <= conf->power_max_p99;
+			if (ok)
+				min_mbm[i] = caps.tx_powers[l];
+			else
+				alive--;
+
+			format_addr(addr, &dsts[i]->addr);
+			fprintf(stdout, "%7.3g %-24s %6u %6u %5.0f%% %9.3f %9.3f%s\n",
+				caps.tx_powers[l] / 100.0f, addr, st.sent, st.received,
+				stats_loss(&st), st.received ? st.rtt_sum / st.received : 0,
+				p99, ok ? "" : "  <- over limit");
+		}
+	}
+
+	/* The router has to reach every destination */
+	need = INT32_MIN;
+	met = 0;
+	fprintf(stdout, "\n");
+	for (i = 0; i < num; i++) {
+		format_addr(addr, &dsts[i]->addr);
+		if (min_mbm[i] == INT32_MIN) {
+			fprintf(stdout, "%s: limits missed even at %.3g dBm\n", addr,
+				caps.tx_powers[0] / 100.0f);
+			need = caps.tx_powers[0];
+			continue;
+		}
+		fprintf(stdout, "%s: minimum %.3g dBm\n", addr, min_mbm[i] / 100.0f);
+		if (min_mbm[i] > need)
+			need = min_mbm[i];
+		met++;
+	}
+
+	/* Nothing met the limits, leave the power as it was */
+	if (!met)
+		need = orig;
+	if (phyctl_set_tx_power(pc, need))
+		goto out;
+	fprintf(stdout, "tx power set to %.3g dBm (iwpan phy <phy> set tx_power %.3g)\n",
+		need / 100.0f, need / 100.0f);
+	ret = 0;
+out:
+	/* Failed or interrupted, do not leave the last level tried behind */
+	if (ret) {
+		if (radio_stop)
+			fprintf(stdout, "\ninterrupted, restoring the original tx power\n");
+		if (phyctl_set_tx_power(pc, orig))
+			fprintf(stderr, "Could not restore the original tx power.\n");
+	}
+	radio_restore_signals(&old_int, &old_term);
+	uring_free(ring);
+	free(rtts);
+	free(hist);
+	free(buf);
+out_pc:
+	phyctl_close(pc);
+	return ret;
+}
+
+/* One data frame sent by us, waiting for the peer's ack */
+struct duplex_slot {
+	uint32_t seq;
+	struct timeval tx_time;
+	bool pending;
+};
+
+struct duplex_stats {
+	struct ping_stats out;
+	unsigned int in_received;
+	unsigned long in_bytes;
+	uint32_t in_first;
+	uint32_t in_last;
+	uint32_t in_total; /* announced by the peer, 0 until seen or unknown */
+	uint32_t in_rtt_avg_us; /* reported by the peer, 0 until seen */
+	uint32_t in_rtt_max_us;
+	struct timeval in_start; /* of the first data frame */
+	struct timeval in_time; /* of the last data frame */
+};
+
+static void duplex_put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+static uint32_t duplex_get32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void duplex_frame(unsigned char *buf, unsigned int len, int type,
+			 uint32_t seq)
+{
+	memset(buf, 0xAB, len);
+	buf[0] = NOT_A_6LOWPAN_FRAME;
+	buf[1] = type;
+	buf[2] = (seq >> 8) & 0xff;
+	buf[3] = seq & 0xff;
+}
+
+static void duplex_expire(struct config *conf, struct duplex_slot *slot)
+{
+	if (!slot->pending)
+		return;
+	slot->pending = false;
+	record_probe(conf, &conf->dst, slot->seq, &slot->tx_time, NULL,
+		     conf->packet_len, RECORD_TIMEOUT);
+}
+
+/* A data frame of the peer, the 16 bit sequence is unwrapped against the last */
+static void duplex_inbound(struct duplex_stats *ds, const unsigned char *buf,
+			   unsigned int seq, ssize_t len, const struct timeval *now)
+{
+	uint32_t ext;
+
+	if (len >= DUPLEX_PAYLOAD_LEN) {
+		ds->in_total = duplex_get32(buf + DUPLEX_TOTAL_OFFSET);
+		ds->in_rtt_avg_us = duplex_get32(buf + DUPLEX_RTT_OFFSET);
+		ds->in_rtt_max_us = duplex_get32(buf + DUPLEX_RTT_OFFSET + 4);
+	}
+	ds->in_time = *now;
+
+	if (!ds->in_received) {
+		ds->in_first = ds->in_last = seq;
+		ds->in_start = *now;
+	} else {
+		ext = ds->in_last + (int16_t)(seq - (ds->in_last & 0xffff));
+		if ((int32_t)(ext - ds->in_last) > 0)
+			ds->in_last = ext;
+	}
+	ds->in_received++;
+	ds->in_bytes += len;
+}
+
+static void duplex_ack(struct config *conf, struct duplex_stats *ds,
+		       struct duplex_slot *window, unsigned int seq,
+		       const struct timeval *now)
+{
+	struct duplex_slot *slot = &window[seq % DUPLEX_WINDOW];
+	float rtt;
+
+	/* The ack only carries the low 16 bits of the sequence */
+	if (!slot->pending || (slot->seq & 0xffff) != seq)
+		return;
+
+	slot->pending = false;
+	rtt = tv_diff_ms(&slot->tx_time, now);
+	stats_add_rtt(&ds->out, rtt);
+	if (conf->adaptive)
+		rto_sample(&conf->rto, rtt);
+	record_probe(conf, &conf->dst, slot->seq, &slot->tx_time, now,
+		     conf->packet_len, RECORD_OK);
+}
+
+static void print_duplex_stats(struct config *conf, const struct duplex_stats *ds)
+{
+	char local[24], peer[24];
+	unsigned int expected;
+	float in_loss = 0, in_ms;
+
+	format_addr(local, &conf->src.addr);
+	format_addr(peer, &conf->dst.addr);
+
+	fprintf(stdout, "\n--- %s <-> %s duplex statistics ---\n", local, peer);
+	fprintf(stdout, "%s -> %s: %u sent, %u acked, %.0f%% loss", local, peer,
+		ds->out.sent, ds->out.received, stats_loss(&ds->out));
+	if (ds->out.received)
+		fprintf(stdout, ", rtt min/avg/max = %.3f/%.3f/%.3f ms",
+			ds->out.rtt_min, ds->out.rtt_sum / ds->out.received,
+			ds->out.rtt_max);
+	fprintf(stdout, "\n");
+
+	/* Without the peer's total only the gaps between its first and last frame count */
+	expected = ds->in_received ? ds->in_last - ds->in_first + 1 : 0;
+	if (ds->in_total)
+		expected = ds->in_total;
+	if (expected)
+		in_loss = 100.0f - (100.0f * ds->in_received) / expected;
+	/* Our own send window says nothing about when the peer's frames came in */
+	in_ms = tv_diff_ms(&ds->in_start, &ds->in_time);
+	fprintf(stdout, "%s -> %s: %u of %u received, %.0f%% loss, %.2f kbps",
+		peer, local, ds->in_received, expected, in_loss,
+		in_ms > 0 ? ds->in_bytes * 8 / in_ms : 0);
+	if (ds->in_rtt_avg_us)
+		fprintf(stdout, ", peer's rtt avg/max = %.3f/%.3f ms",
+			ds->in_rtt_avg_us / 1000.0f, ds->in_rtt_max_us / 1000.0f);
+	fprintf(stdout, "\n");
+}
+
+/* The peer sent all it announced, or fell silent for a timeout */
+static bool duplex_peer_done(struct config *conf, const struct duplex_stats *ds,
+			     const struct timeval *now)
+{
+	if (ds->in_total && ds->in_received && ds->in_last + 1 >= ds->in_total)
+		return true;
+	return tv_diff_ms(&ds->in_time, now) >= probe_timeout(conf);
+}
+
+/*
+ * Both peers run this at once. Every data frame is answered with a short ack,
+ * so the outbound direction is measured by acks and round trip time, the
+ * inbound one by the frames the peer announced against those received. Each
+ * side keeps acking until the peer is done, so -c and -w may differ.
+ */
+static int duplex_run(struct config *conf, struct transport *tr)
+{
+	struct sockaddr_ieee802154 src;
+	struct duplex_slot *window, *slot;
+	struct duplex_stats ds;
+	struct timeval now, run_start, next_tx, last_tx;
+	struct pollfd pfd;
+	unsigned char *buf, *ack;
+	uint64_t period_us, tx_us, total;
+	unsigned int seq;
+	char addr[24];
+	bool sending = true;
+	int i, timeout_ms;
+	ssize_t ret;
+
+	window = calloc(DUPLEX_WINDOW, sizeof(*window));
+	buf = malloc(MAX_PAYLOAD_LEN);
+	ack = malloc(MIN_PAYLOAD_LEN);
+	if (!window || !buf || !ack) {
+		free(window);
+		free(buf);
+		free(ack);
+		return -ENOMEM;
+	}
+
+	/*
+	 * The number of frames is fixed up front so it can be announced. A
+	 * deadline may end the run before that, then nothing is announced and
+	 * the peer counts the gaps. Without either run for a fixed time.
+	 */
+	total = conf->packets;
+	if (!total && !conf->deadline_s)
+		total = (uint64_t)conf->duplex_rate * DUPLEX_SECONDS;
+
+	memset(&ds, 0, sizeof(ds));
+	period_us = 1000000 / conf->duplex_rate;
+	pfd.fd = tr->fd;
+	pfd.events = POLLIN;
+
+	format_addr(addr, &conf->dst.addr);
+	fprintf(stdout, "DUPLEX %s (PAN ID 0x%04x) %u data bytes, %u frames/s\n",
+		addr, conf->dst.addr.pan_id, conf->packet_len, conf->duplex_rate);
+
+	probe_clock(&run_start);
+	next_tx = last_tx = ds.in_time = run_start;
+	for (;;) {
+		probe_clock(&now);
+		if (sending && ((total && ds.out.sent >= total) ||
+				deadline_reached(conf, &run_start)))
+			sending = false;
+
+		if (sending && tv_to_us(&now) >= tv_to_us(&next_tx)) {
+			seq = ds.out.sent++;
+			slot = &window[seq % DUPLEX_WINDOW];
+			duplex_expire(conf, slot);
+
+			duplex_frame(buf, conf->packet_len, DUPLEX_DATA, seq);
+			duplex_put32(buf + DUPLEX_TOTAL_OFFSET,
+				     conf->deadline_s ? 0 : total);
+			if (ds.out.received) {
+				duplex_put32(buf + DUPLEX_RTT_OFFSET,
+					     ds.out.rtt_sum * 1000 / ds.out.received);
+				duplex_put32(buf + DUPLEX_RTT_OFFSET + 4,
+					     ds.out.rtt_max * 1000);
+			} else {
+				memset(buf + DUPLEX_RTT_OFFSET, 0, 8);
+			}
+			ret = transport_send(tr, buf, conf->packet_len, &conf->dst);
+			probe_clock(&last_tx);
+			slot->seq = seq;
+			slot->tx_time = last_tx;
+			slot->pending = ret >= 0;
+			if (ret < 0) {
+				perror("send");
+				record_probe(conf, &conf->dst, seq, &last_tx, NULL,
+					     conf->packet_len, RECORD_ERROR);
+			} else {
+				capture_probe(tr, &last_tx, buf, conf->packet_len,
+					      &conf->dst, false);
+			}
+
+			/* Keep the schedule, a late frame does not shift the next */
+			tx_us = tv_to_us(&next_tx) + period_us;
+			next_tx.tv_sec = tx_us / 1000000;
+			next_tx.tv_usec = tx_us % 1000000;
+			continue;
+		}
+
+		if (sending) {
+			timeout_ms = (tv_to_us(&next_tx) - tv_to_us(&now) + 999) / 1000;
+		} else {
+			/* Our last acks are due, and the peer may still be sending */
+			timeout_ms = probe_timeout(conf) - tv_diff_ms(&last_tx, &now);
+			if (timeout_ms <= 0) {
+				if (duplex_peer_done(conf, &ds, &now))
+					break;
+				timeout_ms = probe_timeout(conf) -
+					     tv_diff_ms(&ds.in_time, &now);
+				if (timeout_ms < 1)
+					timeout_ms = 1;
+			}
+		}
+
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		if (ret <= 0)
+			continue;
+
+		/* Drain the socket, skipping whatever is not from the peer */
+		for (;;) {
+			ret = transport_recv(tr, buf, MAX_PAYLOAD_LEN, MSG_DONTWAIT, &src);
+			if (ret < 0) {
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					perror("recv");
+				break;
+			}
+			probe_clock(&now);
+			capture_probe(tr, &now, buf, ret, &src, true);
+			if (ret < 4 || addr_key(&src.addr) != addr_key(&conf->dst.addr))
+				continue;
+
+			seq = (buf[2] << 8) | buf[3];
+			if (buf[1] == DUPLEX_DATA) {
+				duplex_inbound(&ds, buf, seq, ret, &now);
+				duplex_frame(ack, MIN_PAYLOAD_LEN, DUPLEX_ACK, seq);
+				if (transport_send(tr, ack, MIN_PAYLOAD_LEN, &conf->dst) >= 0)
+					capture_probe(tr, &now, ack, MIN_PAYLOAD_LEN,
+						      &conf->dst, false);
+			} else if (buf[1] == DUPLEX_ACK) {
+				duplex_ack(conf, &ds, window, seq, &now);
+			}
+		}
+	}
+
+	for (i = 0; i < DUPLEX_WINDOW; i++)
+		duplex_expire(conf, &window[i]);
+
+	print_duplex_stats(conf, &ds);
+	free(window);
+	free(buf);
+	free(ack);
+	return 0;
+}
+
+static void server_signal(int sig)
+{
+	if (sig == SIGUSR1)
+		server_report = 1;
+	else
+		server_stop = 1;
+}
+
+/* Only wpan-ping probes carry a sequence, anything else is just echoed */
+static void account_peer(struct server_iface *sif, const unsigned char *buf,
+			 ssize_t len, const struct sockaddr_ieee802154 *src,
+			 uint64_t now_us)
+{
+	if (len < MIN_PAYLOAD_LEN || buf[0] != NOT_A_6LOWPAN_FRAME)
+		return;
+
+	peer_account(&sif->peers, &src->addr, packet_seq(buf, len),
+		     packet_wide_seq(buf, len) ? 32 : 16, len, now_us);
+}
+
+/*
+ * A discovery probe reached every server on the PAN at once. Its echo waits
+ * a random time within the spread the client asked for, so the responders
+ * do not all contend for the channel in the same instant. With the queue
+ * full it goes out right away.
+ */
+static bool defer_echo(struct echo_queue *q, struct server_iface *sif,
+		       const unsigned char *buf, ssize_t len,
+		       const struct sockaddr_ieee802154 *src, uint64_t now_us)
+{
+	struct deferred_echo *d;
+	unsigned int spread;
+
+	if (len < DISCOVER_PAYLOAD_LEN || buf[DISCOVER_MAGIC_OFFSET] != DISCOVER_MAGIC ||
+	    q->num >= MAX_DEFERRED)
+		return false;
+
+	spread = (buf[DISCOVER_SPREAD_OFFSET] << 8) | buf[DISCOVER_SPREAD_OFFSET + 1];
+	d = &q->slots[q->num++];
+	d->sif = sif;
+	d->due_us = now_us + (uint64_t)(random() % (spread + 1)) * 1000;
+	d->dst = *src;
+	d->len = len;
+	memcpy(d->buf, buf, len);
+	return true;
+}
+
+/* epoll timeout until the next deferred echo is due */
+static int deferred_timeout(const struct echo_queue *q)
+{
+	uint64_t now = owd_now_us(), next = UINT64_MAX;
+	unsigned int i;
+
+	for (i = 0; i < q->num; i++) {
+		if (q->slots[i].due_us < next)
+			next = q->slots[i].due_us;
+	}
+
+	if (next == UINT64_MAX)
+		return -1;
+	return next > now ? (next - now + 999) / 1000 : 0;
+}
+
+/*
+ * The server sockets are non-blocking for the receive side. A full TX
+ * queue is waited out rather than dropping the echo.
+ */
+static bool wait_writable(int sd)
+{
+	struct pollfd pfd = { .fd = sd, .events = POLLOUT };
+
+	return poll(&pfd, 1, ECHO_TX_WAIT_MS) > 0;
+}
+
+static ssize_t echo_sendto(int sd, const void *buf, size_t len,
+			   const struct sockaddr_ieee802154 *dst)
+{
+	ssize_t ret;
+
+	while ((ret = sendto(sd, buf, len, 0, (const struct sockaddr *)dst,
+			     sizeof(*dst))) < 0 &&
+	       (errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(sd))
+		;
+	return ret;
+}
+
+static void send_deferred(struct echo_queue *q)
+{
+	uint64_t now = owd_now_us();
+	struct deferred_echo *d;
+	unsigned int i = 0;
+	ssize_t len;
+
+	while (i < q->num) {
+		d = &q->slots[i];
+		if (d->due_us > now) {
+			i++;
+			continue;
+		}
+
+		len = echo_sendto(d->sif->sd, d->buf, d->len, &d->dst);
+		if (len < 0) {
+			perror("sendto");
+			d->sif->errors++;
+		} else {
+			d->sif->tx_packets++;
+			d->sif->tx_bytes += len;
+		}
+		*d = q->slots[--q->num];
+	}
+}
+
+static void echo_packet(struct server_iface *sif, unsigned char *buf,
+			struct echo_queue *q)
+{
+	struct sockaddr_ieee802154 src;
+	socklen_t addrlen;
+	uint64_t rx_us;
+	ssize_t len;
+
+	addrlen = sizeof(src);
+	len = recvfrom(sif->sd, buf, MAX_PAYLOAD_LEN, 0, (struct sockaddr *)&src, &addrlen);
+	if (len < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			perror("recvfrom");
+			sif->errors++;
+		}
+		return;
+	}
+	rx_us = owd_now_us();
+	sif->rx_packets++;
+	sif->rx_bytes += len;
+	account_peer(sif, buf, len, &src, rx_us);
+	if (defer_echo(q, sif, buf, len, &src, rx_us))
+		return;
+
+	//dump_packet(buf, len);
+	/* Send same packet back, stamped if the client asked for it */
+	owd_stamp(buf, len, rx_us, owd_now_us());
+	len = echo_sendto(sif->sd, buf, len, &src);
+	if (len < 0) {
+		perror("sendto");
+		sif->errors++;
+		return;
+	}
+	sif->tx_packets++;
+	sif->tx_bytes += len;
+}
+
+static void init_echo_batch(struct echo_batch *batch)
+{
+	int i;
+
+	memset(batch, 0, sizeof(*batch));
+	for (i = 0; i < MAX_BATCH; i++) {
+		batch->iov[i].iov_base = batch->bufs[i];
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+	}
+}
+
+static void account_batch(struct server_iface *sif, unsigned int n)
+{
+	unsigned int bucket = 0;
+
+	while ((n >> (bucket + 1)) && bucket < BATCH_HIST_SIZE - 1)
+		bucket++;
+
+	sif->batches++;
+	sif->batch_hist[bucket]++;
+	if (n > sif->batch_max)
+		sif->batch_max = n;
+}
+
+/* Drain up to size packets with one recvmmsg and echo them with sendmmsg */
+static void echo_batch(struct server_iface *sif, struct echo_batch *batch,
+		       unsigned int size, struct echo_queue *q)
+{
+	unsigned int i, m, sent;
+	uint64_t rx_us, tx_us;
+	int n, ret;
+
+	/* Deferred echoes of the last batch may have moved the headers */
+	for (i = 0; i < size; i++) {
+		batch->iov[i].iov_len = MAX_PAYLOAD_LEN;
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+		batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+	}
+
+	n = recvmmsg(sif->sd, batch->msgs, size, MSG_DONTWAIT, NULL);
+	if (n <= 0) {
+		if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			perror("recvmmsg");
+			sif->errors++;
+		}
+		return;
+	}
+	rx_us = owd_now_us();
+	account_batch(sif, n);
+
+	tx_us = owd_now_us();
+	for (i = 0, m = 0; i < (unsigned int)n; i++) {
+		sif->rx_packets++;
+		sif->rx_bytes += batch->msgs[i].msg_len;
+		account_peer(sif, batch->bufs[i], batch->msgs[i].msg_len,
+			     &batch->addrs[i], rx_us);
+		if (defer_echo(q, sif, batch->bufs[i], batch->msgs[i].msg_len,
+			       &batch->addrs[i], rx_us))
+			continue;
+		/* Send same packets back */
+		batch->iov[i].iov_len = batch->msgs[i].msg_len;
+		owd_stamp(batch->bufs[i], batch->msgs[i].msg_len, rx_us, tx_us);
+		batch->msgs[m++] = batch->msgs[i];
+	}
+
+	for (sent = 0; sent < m; sent += ret) {
+		ret = sendmmsg(sif->sd, &batch->msgs[sent], m - sent, 0);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+		    wait_writable(sif->sd)) {
+			ret = 0;
+			continue;
+		}
+		if (ret < 0) {
+			perror("sendmmsg");
+			/* Skip the failing packet, keep the rest of the batch */
+			sif->errors++;
+			ret = 1;
+			continue;
+		}
+		for (i = sent; i < sent + ret; i++) {
+			sif->tx_packets++;
+			sif->tx_bytes += batch->msgs[i].msg_hdr.msg_iov->iov_len;
+		}
+	}
+}
+
+static void print_server_stats(struct server_iface *sifs, int num)
+{
+	int i, j;
+
+	fprintf(stdout, "\n--- server statistics ---\n");
+	for (i = 0; i < num; i++) {
+		fprintf(stdout, "%s: %lu packets (%lu bytes) received, "
+			"%lu packets (%lu bytes) echoed, %lu errors\n",
+			sifs[i].iface->name, sifs[i].rx_packets, sifs[i].rx_bytes,
+			sifs[i].tx_packets, sifs[i].tx_bytes, sifs[i].errors);
+		if (!sifs[i].batches)
+			continue;
+
+		fprintf(stdout, "\tbatches %lu, avg %.1f, max %u packets/batch\n\thistogram:",
+			sifs[i].batches, (float)sifs[i].rx_packets / sifs[i].batches,
+			sifs[i].batch_max);
+		for (j = 0; j < BATCH_HIST_SIZE; j++) {
+			if (sifs[i].batch_hist[j])
+				fprintf(stdout, " [%u-%u] %lu", 1U << j, (2U << j) - 1,
+					sifs[i].batch_hist[j]);
+		}
+		fprintf(stdout, "\n");
+	}
+}
+
+/*
+ * Received frames of every source, inbound loss shows as gaps; the loss the
+ * client sees beyond that happened on the way back.
+ */
+static void print_peer_stats(struct server_iface *sifs, int num)
+{
+	uint64_t now = owd_now_us();
+	unsigned int j, n;
+	struct peer **list;
+	struct peer *p;
+	char addr[24];
+	int i;
+
+	for (i = 0; i < num; i++) {
+		list = peer_table_list(&sifs[i].peers, &n);
+		if (!list)
+			continue;
+
+		fprintf(stdout, "\n%s: %u peer(s)", sifs[i].iface->name, n);
+		if (sifs[i].peers.untracked)
+			fprintf(stdout, ", %lu frames from untracked peers",
+				sifs[i].peers.untracked);
+		fprintf(stdout, "\n%-24s %6s %8s %10s %6s %6s %6s %6s %4s %9s\n",
+			"address", "pan", "frames", "bytes", "gaps", "dups", "reord",
+			"stale", "runs", "last seen");
+		for (j = 0; j < n; j++) {
+			p = list[j];
+			format_addr(addr, &p->addr);
+			fprintf(stdout, "%-24s 0x%04x %8lu %10lu %6lu %6lu %6lu %6lu %4lu %8.1fs\n",
+				addr, p->addr.pan_id, p->frames, p->bytes, p->gaps,
+				p->duplicates, p->reordered, p->stale, p->restarts + 1,
+				(now - p->last_us) / 1000000.0);
+		}
+		free(list);
+	}
+}
+
+/* Select the interfaces named in the comma separated conf->interface list */
+static int select_server_ifaces(struct config *conf, struct server_iface *sifs)
+{
+	const struct wpan_iface *iface;
+	char *list, *name, *saveptr;
+	int i, num = 0;
+
+	if (!strcmp(conf->interface, "all")) {
+		for (i = 0; i < conf->num_ifaces; i++)
+			sifs[num++].iface = &conf->ifaces[i];
+		return num;
+	}
+
+	list = strdup(conf->interface);
+	if (!list)
+		return -ENOMEM;
+
+	for (name = strtok_r(list, ",", &saveptr); name;
+	     name = strtok_r(NULL, ",", &saveptr)) {
+		iface = find_interface(conf, name);
+		if (!iface) {
+			fprintf(stderr, "Interface %s not found.\n", name);
+			free(list);
+			return -ENODEV;
+		}
+		for (i = 0; i < num && sifs[i].iface != iface; i++)
+			;
+		if (i < num) {
+			fprintf(stderr, "Interface %s given twice.\n", name);
+			free(list);
+			return -EINVAL;
+		}
+		if (num == MAX_INTERFACES) {
+			fprintf(stderr, "At most %d interfaces can be served.\n",
+				MAX_INTERFACES);
+			free(list);
+			return -E2BIG;
+		}
+		sifs[num++].iface = iface;
+	}
+
+	free(list);
+	return num;
+}
+
+static int init_server(struct config *conf) {
+	struct server_iface sifs[MAX_INTERFACES];
+	struct epoll_event ev, events[MAX_INTERFACES];
+	struct sigaction sa;
+	struct sockaddr_ieee802154 src;
+	struct echo_batch *batch = NULL;
+	struct echo_queue *deferred;
+	unsigned char *buf;
+	int i, n, num, efd, ret = 1;
+
+	memset(sifs, 0, sizeof(sifs));
+	num = select_server_ifaces(conf, sifs);
+	if (num <= 0) {
+		if (!num)
+			fprintf(stderr, "No wpan interface to serve.\n");
+		return 1;
+	}
+
+	efd = epoll_create1(0);
+	if (efd < 0) {
+		perror("epoll_create1");
+		return 1;
+	}
+
+	for (i = 0; i < num; i++)
+		sifs[i].sd = -1;
+
+	for (i = 0; i < num; i++) {
+		if (peer_table_init(&sifs[i].peers)) {
+			perror("peer_table_init");
+			goto out;
+		}
+		fill_src_addr(conf, sifs[i].iface, &src);
+		sifs[i].sd = ieee802154_socket(&src);
+		if (sifs[i].sd < 0)
+			goto out;
+
+		/* Never block on one interface while others have packets */
+		fcntl(sifs[i].sd, F_SETFL, fcntl(sifs[i].sd, F_GETFL) | O_NONBLOCK);
+
+		ev.events = EPOLLIN;
+		ev.data.ptr = &sifs[i];
+		if (epoll_ctl(efd, EPOLL_CTL_ADD, sifs[i].sd, &ev)) {
+			perror("epoll_ctl");
+			goto out;
+		}
+	}
+
+	/* No SA_RESTART, a pending epoll_wait returns and the loop notices */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = server_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGUSR1, &sa, NULL);
+
+	fprintf(stdout, "Server mode on %i interface(s). Waiting for packets...\n", num);
+	buf = (unsigned char *)malloc(MAX_PAYLOAD_LEN);
+	deferred = calloc(1, sizeof(*deferred));
+	if (!deferred) {
+		free(buf);
+		goto out;
+	}
+	if (conf->batch > 1) {
+		batch = malloc(sizeof(*batch));
+		if (!batch) {
+			free(deferred);
+			free(buf);
+			goto out;
+		}
+		init_echo_batch(batch);
+	}
+	/* Servers started together must not pick the same backoffs */
+	srandom(owd_now_us() ^ getpid());
+
+	while (!server_stop) {
+		if (server_report) {
+			server_report = 0;
+			print_server_stats(sifs, num);
+			print_peer_stats(sifs, num);
+			fflush(stdout);
+		}
+		n = epoll_wait(efd, events, MAX_INTERFACES, deferred_timeout(deferred));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			if (batch)
+				echo_batch(events[i].data.ptr, batch, conf->batch, deferred);
+			else
+				echo_packet(events[i].data.ptr, buf, deferred);
+		}
+		send_deferred(deferred);
+	}
+	free(batch);
+	free(deferred);
+	free(buf);
+
+	print_server_stats(sifs, num);
+	print_peer_stats(sifs, num);
+	ret = 0;
+out:
+	for (i = 0; i < num; i++) {
+		peer_table_free(&sifs[i].peers);
+		if (sifs[i].sd < 0)
+			continue;
+		shutdown(sifs[i].sd, SHUT_RDWR);
+		close(sifs[i].sd);
+	}
+	close(efd);
+	return ret;
+}
+
+/*
+ * Applied after the transport is open, so helper threads like the loop
+ * reflector keep their own CPU and scheduling. The overhead is measured
+ * with the settings in place.
+ */
+static void rt_start(struct config *conf, struct transport *tr)
+{
+	struct timespec start, end;
+	struct rt_overhead ov;
+	unsigned char byte;
+	int i;
+
+	rt_enter(&conf->rt);
+	rt_measure(&ov);
+	fprintf(stdout, "rt: self overhead: clock read %.3f us, wakeup latency "
+		"min/avg/max %.1f/%.1f/%.1f us", ov.clock, ov.wake_min, ov.wake_avg,
+		ov.wake_max);
+
+	if (conf->rt.busy) {
+		/* Nothing is in flight yet, every recv comes back empty */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < BUSY_POLL_SAMPLES; i++)
+			transport_recv(tr, &byte, sizeof(byte), MSG_DONTWAIT, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		fprintf(stdout, ", busy poll %.3f us",
+			((end.tv_sec - start.tv_sec) * 1e6 +
+			 (end.tv_nsec - start.tv_nsec) / 1e3) / BUSY_POLL_SAMPLES);
+	}
+	fprintf(stdout, "\n");
+}
+
+static int init_network(struct config *conf) {
+	struct transport *tr = conf->transport;
+
+	if (conf->server)
+		return init_server(conf);
+
+	if (transport_open(tr, &conf->src))
+		return 1;
+	transport_addr(tr, &conf->src);
+
+	if (conf->record_path) {
+		conf->recorder = record_open(conf->record_path, conf->record_format);
+		if (!conf->recorder) {
+			perror(conf->record_path);
+			transport_close(tr);
+			return 1;
+		}
+	}
+
+	if (conf->pcap_path) {
+		tr->capture = capture_open(conf->pcap_path, conf->interface, &conf->src);
+		if (!tr->capture) {
+			perror(conf->pcap_path);
+			record_close(conf->recorder);
+			transport_close(tr);
+			return 1;
+		}
+	}
+
+	if (conf->rt.enabled)
+		rt_start(conf, tr);
+
+	if (conf->discover_ms)
+		discover(conf, tr);
+	else if (conf->monitor)
+		monitor(conf, tr);
+	else if (conf->power_sweep)
+		power_sweep(conf, tr);
+	else if (conf->num_targets)
+		sweep_targets(conf, tr);
+	else if (conf->sweep_size)
+		sweep_sizes(conf, tr);
+	else if (conf->probe_mtu)
+		probe_mtu(conf, tr);
+	else if (conf->duplex_rate)
+		duplex_run(conf, tr);
+	else if (conf->tune_mac)
+		tune_mac(conf, tr);
+	else
+		measure_roundtrip(conf, tr);
+
+	record_close(conf->recorder);
+	capture_close(tr->capture);
+	tr->capture = NULL;
+
+	transport_close(tr);
+	return 0;
+}
+
+static int parse_addr(struct config *conf, char *arg, struct sockaddr_ieee802154 *sa)
+{
+	int i;
+
+	/* PAN ID is filled from netlink in get_interface_info */
+	sa->family = AF_IEEE802154;
+
+	if (!conf->extended) {
+		sa->addr.addr_type = IEEE802154_ADDR_SHORT;
+		sa->addr.short_addr = strtol(arg, NULL, 16);
+		return 0;
+	}
+
+	sa->addr.addr_type = IEEE802154_ADDR_LONG;
+
+	for (i = 0; i < IEEE802154_ADDR_LEN; i++) {
+		int temp;
+		char *cp = strchr(arg, ':');
+		if (cp) {
+			*cp = 0;
+			cp++;
+		}
+		if (sscanf(arg, "%x", &temp) != 1)
+			return -1;
+		if (temp < 0 || temp > 255)
+			return -1;
+
+		sa->addr.hwaddr[i] = temp;
+		if (!cp)
+			break;
+		arg = cp;
+	}
+	if (i < IEEE802154_ADDR_LEN - 1)
+		return -1;
+
+	return 0;
+}
+
+static int parse_dst_addr(struct config *conf, char *arg)
+{
+	return parse_addr(conf, arg, &conf->dst);
+}
+
+/* Decimal option argument, strtoul alone would take signs and trailing junk */
+static int parse_uint(const char *arg, unsigned int *val)
+{
+	unsigned long v;
+	char *end;
+
+	if (*arg < '0' || *arg > '9')
+		return -1;
+
+	errno = 0;
+	v = strtoul(arg, &end, 10);
+	if (errno || *end || v > UINT_MAX)
+		return -1;
+
+	*val = v;
+	return 0;
+}
+
+/* Parse [min[:max[:step]]], missing parts keep their defaults */
+static int parse_size_range(struct config *conf, const char *arg)
+{
+	/* size_max 0 stands for the interface maximum, checked in main */
+	conf->size_min = MIN_PAYLOAD_LEN;
+	conf->size_max = 0;
+	conf->size_step = SWEEP_SIZE_STEP;
+
+	if (arg && sscanf(arg, "%u:%u:%u", &conf->size_min, &conf->size_max,
+			  &conf->size_step) < 1)
+		return -1;
+
+	if (conf->size_min < MIN_PAYLOAD_LEN || !conf->size_step ||
+	    (conf->size_max && conf->size_min > conf->size_max))
+		return -1;
+
+	return 0;
+}
+
+/* Add a comma separated list of addresses or short address ranges */
+static int add_target_spec(struct config *conf, char *spec)
+{
+	struct sockaddr_ieee802154 sa;
+	char *item, *saveptr, *dash;
+	unsigned long first, last, a;
+
+	for (item = strtok_r(spec, ",", &saveptr); item;
+	     item = strtok_r(NULL, ",", &saveptr)) {
+		memset(&sa, 0, sizeof(sa));
+		dash = strchr(item, '-');
+		if (dash && !conf->extended) {
+			*dash = 0;
+			first = strtoul(item, NULL, 16);
+			last = strtoul(dash + 1, NULL, 16);
+			if (last < first || last > 0xfffe)
+				return -1;
+			for (a = first; a <= last; a++) {
+				sa.family = AF_IEEE802154;
+				sa.addr.addr_type = IEEE802154_ADDR_SHORT;
+				sa.addr.short_addr = a;
+				if (add_target(conf, &sa))
+					return -1;
+			}
+			continue;
+		}
+
+		if (parse_addr(conf, item, &sa) || add_target(conf, &sa))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int load_targets(struct config *conf, const char *path)
+{
+	char line[128], *p;
+	FILE *f;
+	int ret = 0;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		p = line + strspn(line, " \t");
+		p[strcspn(p, "#\r\n \t")] = 0;
+		if (!*p)
+			continue;
+		ret = add_target_spec(conf, p);
+		if (ret)
+			break;
+	}
+
+	fclose(f);
+	return ret;
+}
+
+int main(int argc, char *argv[]) {
+	int c, ret;
+	struct config *conf;
+	char *dst_addr = NULL;
+	char *targets_file = NULL;
+
+	conf = calloc(1, sizeof(struct config));
+
+	/* Default to interface wpan0 if nothing else is given */
+	conf->interface = "wpan0";
+
+	/* Deafult to minimum packet size */
+	conf->packet_len = MIN_PAYLOAD_LEN;
+
+	/* Default to short addressing */
+	conf->extended = false;
+
+	/* Adaptive timeouts start from the fixed one */
+	rto_init(&conf->rto);
+
+	if (argc < 2) {
+		usage(argv[0]);
+		exit(1);
+	}
+
+	while (1) {
+#ifdef HAVE_GETOPT_LONG
+		int opt_idx = -1;
+		c = getopt_long(argc, argv, "b:a:ec:s:i:duN:f:At:w:r:R:qS::MT:D:CP::k::xB::m::L::W:vh", perf_long_opts, &opt_idx);
+#else
+		c = getopt(argc, argv, "b:a:ec:s:i:duN:f:At:w:r:R:qS::MT:D:CP::k::xB::m::L::W:vh");
+#endif
+		if (c == -1)
+			break;
+		switch(c) {
+		case 'a':
+			dst_addr = optarg;
+			break;
+		case 'e':
+			conf->extended = true;
+			break;
+		case 'd':
+			conf->server = true;
+			break;
+		case 'c':
+			if (parse_uint(optarg, &conf->packets)) {
+				printf("Count must be a number of packets.\n");
+				return 1;
+			}
+			break;
+		case 's':
+			/* The upper bound depends on the interface, see below */
+			conf->packet_len = atoi(optarg);
+			if (conf->packet_len < MIN_PAYLOAD_LEN) {
+				printf("Packet size must be at least %i.\n", MIN_PAYLOAD_LEN);
+				return 1;
+			}
+			break;
+		case 'i':
+			conf->interface = optarg;
+			break;
+		case 'u':
+			conf->uring = true;
+			break;
+		case 'N':
+			if (parse_uint(optarg, &conf->window) ||
+			    conf->window < 1 || conf->window > URING_WINDOW_MAX) {
+				printf("Window must be between 1 and %i probes.\n",
+				       URING_WINDOW_MAX);
+				return 1;
+			}
+			break;
+		case 'f':
+			targets_file = optarg;
+			break;
+		case 'A':
+			conf->adaptive = true;
+			break;
+		case 't':
+			if (parse_uint(optarg, &conf->interval_ms)) {
+				printf("Interval must be a number of ms.\n");
+				return 1;
+			}
+			break;
+		case 'w':
+			if (parse_uint(optarg, &conf->deadline_s)) {
+				printf("Deadline must be a number of seconds.\n");
+				return 1;
+			}
+			break;
+		case 'r':
+			conf->record_path = optarg;
+			break;
+		case 'R':
+			if (record_parse_format(optarg, &conf->record_format)) {
+				printf("Record format must be csv, ndjson or bin.\n");
+				return 1;
+			}
+			break;
+		case 'q':
+			conf->quiet = true;
+			break;
+		case 'M':
+			conf->probe_mtu = true;
+			break;
+		case 'D':
+			if (parse_uint(optarg, &conf->duplex_rate) ||
+			    !conf->duplex_rate || conf->duplex_rate > DUPLEX_MAX_RATE) {
+				printf("Duplex rate must be between 1 and %i frames per second.\n",
+				       DUPLEX_MAX_RATE);
+				return 1;
+			}
+			break;
+		case 'C':
+			conf->tune_mac = true;
+			break;
+		case 'P':
+			conf->power_sweep = true;
+			conf->power_max_loss = POWER_MAX_LOSS;
+			conf->power_max_p99 = POWER_MAX_P99_MS;
+			if (optarg && sscanf(optarg, "%f:%f", &conf->power_max_loss,
+					     &conf->power_max_p99) < 1) {
+				printf("Power sweep limits must be loss%%:p99ms.\n");
+				return 1;
+			}
+			break;
+		case 'k':
+			conf->soak_interval_s = SOAK_INTERVAL_S;
+			if (optarg && (parse_uint(optarg, &conf->soak_interval_s) ||
+				       !conf->soak_interval_s)) {
+				printf("Soak interval must be at least one second.\n");
+				return 1;
+			}
+			break;
+		case 'x':
+			conf->timestamps = true;
+			break;
+		case 'B':
+			conf->discover_ms = DISCOVER_WINDOW_MS;
+			if (optarg && (parse_uint(optarg, &conf->discover_ms) ||
+				       !conf->discover_ms)) {
+				printf("Discovery window must be at least one ms.\n");
+				return 1;
+			}
+			break;
+		case 'm':
+			conf->monitor = true;
+			conf->monitor_path = optarg;
+			break;
+		case 'L':
+			if (rt_parse(optarg, &conf->rt)) {
+				printf("Real-time options must be cpu=n,fifo[=prio],busy.\n");
+				return 1;
+			}
+			break;
+		case 'W':
+			conf->pcap_path = optarg;
+			break;
+		case 'T':
+			transport_free(conf->transport);
+			conf->transport = transport_new(optarg);
+			if (!conf->transport) {
+				printf("Unknown transport or options: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'S':
+			conf->sweep_size = true;
+			if (parse_size_range(conf, optarg)) {
+				printf("Size sweep must be min:max:step starting at %i.\n",
+				       MIN_PAYLOAD_LEN);
+				return 1;
+			}
+			break;
+		case 'b':
+			conf->batch = atoi(optarg);
+			if (conf->batch < 1 || conf->batch > MAX_BATCH) {
+				printf("Batch size must be between 1 and %i.\n", MAX_BATCH);
+				return 1;
+			}
+			break;
+		case 'v':
+			fprintf(stdout, "wpan-ping 0.1\n");
+			return 1;
+		case 'h':
+			usage(argv[0]);
+			return 1;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!conf->transport)
+		conf->transport = transport_new(ieee802154_transport.name);
+
+	if (transport_native(conf->transport)) {
+		if (get_interface_info(conf))
+			return 1;
+	} else if (conf->server || conf->tune_mac || conf->power_sweep) {
+		fprintf(stderr, "%s needs the %s transport.\n",
+			conf->server ? "Daemon mode" : "Changing radio settings",
+			ieee802154_transport.name);
+		return 1;
+	} else {
+		virtual_interface(conf);
+	}
+
+	if (!conf->server) {
+		const struct wpan_iface *iface;
+
+		iface = find_interface(conf, conf->interface);
+		if (!iface) {
+			fprintf(stderr, "Interface %s not found.\n", conf->interface);
+			return 1;
+		}
+		fill_src_addr(conf, iface, &conf->src);
+
+		/* Soak runs outlive 16 bit sequences */
+		if (conf->soak_interval_s && conf->packet_len < WIDE_SEQ_PAYLOAD_LEN)
+			conf->packet_len = WIDE_SEQ_PAYLOAD_LEN;
+		if (conf->timestamps && conf->packet_len < OWD_PAYLOAD_LEN)
+			conf->packet_len = OWD_PAYLOAD_LEN;
+		if (conf->duplex_rate && conf->packet_len < DUPLEX_PAYLOAD_LEN)
+			conf->packet_len = DUPLEX_PAYLOAD_LEN;
+		if (conf->discover_ms && conf->packet_len < DISCOVER_PAYLOAD_LEN)
+			conf->packet_len = DISCOVER_PAYLOAD_LEN;
+		if (conf->rt.busy && conf->uring) {
+			fprintf(stderr, "Busy polling replaces the io_uring engine.\n");
+			return 1;
+		}
+		if (conf->window > 1 && !conf->uring) {
+			fprintf(stderr, "A probe window needs the io_uring engine (-u).\n");
+			return 1;
+		}
+		if (conf->discover_ms && (conf->timestamps || dst_addr || targets_file)) {
+			fprintf(stderr, "Discovery takes neither destinations nor timestamps.\n");
+			return 1;
+		}
+
+		conf->max_payload = iface_max_payload(conf, iface);
+		if (conf->packet_len > conf->max_payload) {
+			printf("Packet size must be between %i and %u on %s (MTU %u).\n",
+			       MIN_PAYLOAD_LEN, conf->max_payload, iface->name, iface->mtu);
+			return 1;
+		}
+		if (!conf->size_max)
+			conf->size_max = conf->max_payload;
+		if (conf->sweep_size && (conf->size_max > conf->max_payload ||
+					 conf->size_min > conf->size_max)) {
+			printf("Size sweep must stay between %i and %u on %s (MTU %u).\n",
+			       MIN_PAYLOAD_LEN, conf->max_payload, iface->name, iface->mtu);
+			return 1;
+		}
+
+		if (conf->discover_ms) {
+			conf->dst.family = AF_IEEE802154;
+			conf->dst.addr.addr_type = IEEE802154_ADDR_SHORT;
+			conf->dst.addr.short_addr = BROADCAST_SHORT_ADDR;
+			ret = 0;
+		} else if (targets_file && load_targets(conf, targets_file)) {
+			fprintf(stderr, "Address in %s given in wrong format.\n", targets_file);
+			return 1;
+		} else if (dst_addr && (conf->monitor || targets_file || strchr(dst_addr, ',') ||
+					(!conf->extended && strchr(dst_addr, '-')))) {
+			ret = add_target_spec(conf, dst_addr);
+		} else if (dst_addr) {
+			ret = parse_dst_addr(conf, dst_addr);
+		} else {
+			ret = conf->num_targets ? 0 : -1;
+		}
+		if (ret< 0) {
+			fprintf(stderr, "Address given in wrong format.\n");
+			return 1;
+		}
+		if (conf->num_targets)
+			unique_targets(conf);
+		conf->dst.addr.pan_id = iface->pan_id;
+	}
+	ret = init_network(conf);
+	transport_free(conf->transport);
+	free(conf->targets);
+	free(conf);
+	return ret;
 }
@@ -0,0 +1,378 @@
+/*
+ * Offline analyzer for wpan-ping binary traces
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <endian.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+/*
+ * RTTs are binned into a log-linear histogram: 1 us resolution below
+ * 1024 us and 512 sub-buckets per power of two above, which keeps the
+ * relative error of the percentiles below 0.2 % for any RTT up to ~71 min.
+ */
+#define HIST_SUB_BITS 9
+#define HIST_SUB (1U << HIST_SUB_BITS)
+#define HIST_SIZE (24 * HIST_SUB)
+/* Longest bucket, a year, far below where the us value would overflow */
+#define BUCKET_MAX_S (366 * 24 * 3600ULL)
+
+#ifdef HAVE_GETOPT_LONG
+static const struct option trace_long_opts[] = {
+	{ "bucket", required_argument, NULL, 'b' },
+	{ "version", no_argument, NULL, 'v' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+#endif
+
+struct trace_stats {
+	uint64_t probes;
+	uint64_t ok;
+	uint64_t timeout;
+	uint64_t error;
+	uint64_t rtt_sum;
+	uint32_t rtt_min;
+	uint32_t rtt_max;
+	uint32_t hist[HIST_SIZE];
+};
+
+static void usage(const char *name)
+{
+	printf("Usage: %s OPTIONS trace...\n"
+	"OPTIONS:\n"
+	"--bucket | -b print a summary for every bucket of this many seconds\n"
+	"--version | -v print out version\n"
+	"--help This usage text\n", name);
+}
+
+static unsigned int hist_index(uint32_t v)
+{
+	unsigned int shift;
+
+	if (v < 2 * HIST_SUB)
+		return v;
+
+	shift = 31 - __builtin_clz(v) - HIST_SUB_BITS;
+	return shift * HIST_SUB + (v >> shift);
+}
+
+/* Midpoint of the values falling into histogram bucket idx */
+static double hist_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < 2 * HIST_SUB)
+		return idx;
+
+	shift = idx / HIST_SUB - 1;
+	return (double)((uint64_t)(idx - shift * HIST_SUB) << shift) +
+	       ((1U << shift) - 1) / 2.0;
+}
+
+static void stats_reset(struct trace_stats *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->rtt_min = TRACE_RTT_NONE;
+}
+
+/*
+ * Scan records [from, to) of one block. The counting loops are kept free of
+ * branches so the compiler can vectorize them, only the histogram update
+ * needs a scalar pass.
+ */
+static void stats_scan(struct trace_stats *st, const struct trace_columns *c,
+		       uint32_t from, uint32_t to)
+{
+	uint64_t ok = 0, sum = 0, timeout = 0, error = 0;
+	uint32_t min = st->rtt_min, max = st->rtt_max;
+	uint32_t i, rtt, valid;
+
+	for (i = from; i < to; i++) {
+		rtt = le32toh(c->rtt_us[i]);
+		valid = rtt != TRACE_RTT_NONE;
+		ok += valid;
+		sum += valid ? rtt : 0;
+		/* TRACE_RTT_NONE is UINT32_MAX and never lowers the minimum */
+		min = rtt < min ? rtt : min;
+		max = valid && rtt > max ? rtt : max;
+	}
+
+	for (i = from; i < to; i++) {
+		timeout += c->status[i] == RECORD_TIMEOUT;
+		error += c->status[i] == RECORD_ERROR;
+	}
+
+	for (i = from; i < to; i++) {
+		rtt = le32toh(c->rtt_us[i]);
+		if (rtt != TRACE_RTT_NONE)
+			st->hist[hist_index(rtt)]++;
+	}
+
+	st->probes += to - from;
+	st->ok += ok;
+	st->rtt_sum += sum;
+	st->rtt_min = min;
+	st->rtt_max = max;
+	st->timeout += timeout;
+	st->error += error;
+}
+
+static void stats_merge(struct trace_stats *dst, const struct trace_stats *src)
+{
+	unsigned int i;
+
+	dst->probes += src->probes;
+	dst->ok += src->ok;
+	dst->timeout += src->timeout;
+	dst->error += src->error;
+	dst->rtt_sum += src->rtt_sum;
+	if (src->rtt_min < dst->rtt_min)
+		dst->rtt_min = src->rtt_min;
+	if (src->rtt_max > dst->rtt_max)
+		dst->rtt_max = src->rtt_max;
+	for (i = 0; i < HIST_SIZE; i++)
+		dst->hist[i] += src->hist[i];
+}
+
+/* Percentile p (0..1) of the received RTTs in ms */
+static double stats_percentile(const struct trace_stats *st, double p)
+{
+	uint64_t rank, seen = 0;
+	unsigned int i;
+	double v;
+
+	if (!st->ok)
+		return 0;
+
+	rank = (uint64_t)(p * st->ok);
+	if (rank >= st->ok)
+		rank = st->ok - 1;
+
+	for (i = 0; i < HIST_SIZE; i++) {
+		seen += st->hist[i];
+		if (seen > rank)
+			break;
+	}
+
+	/* The bucket midpoint may lie just outside the observed range */
+	v = hist_value(i);
+	if (v > st->rtt_max)
+		v = st->rtt_max;
+	if (v < st->rtt_min)
+		v = st->rtt_min;
+
+	return v / 1000;
+}
+
+static double stats_loss(const struct trace_stats *st)
+{
+	return st->probes ? 100.0 - (100.0 * st->ok) / st->probes : 0;
+}
+
+static void print_bucket_header(void)
+{
+	fprintf(stdout, "%-19s %10s %7s %9s %9s %9s %9s\n", "time", "probes",
+		"loss", "p50", "p90", "p99", "max ms");
+}
+
+static void print_bucket(uint64_t start_us, const struct trace_stats *st)
+{
+	time_t t = start_us / 1000000;
+	char date[32];
+
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&t));
+	fprintf(stdout, "%-19s %10llu %6.2f%% %9.3f %9.3f %9.3f %9.3f\n", date,
+		(unsigned long long)st->probes, stats_loss(st),
+		stats_percentile(st, 0.5), stats_percentile(st, 0.9),
+		stats_percentile(st, 0.99), st->ok ? st->rtt_max / 1000.0 : 0);
+}
+
+static void print_summary(const struct trace_stats *st, int files)
+{
+	fprintf(stdout, "\n--- %i trace(s), %llu probes ---\n", files,
+		(unsigned long long)st->probes);
+	fprintf(stdout, "%llu received, %llu timeout, %llu error, "
+		"%.3f%% packet loss\n", (unsigned long long)st->ok,
+		(unsigned long long)st->timeout, (unsigned long long)st->error,
+		stats_loss(st));
+	if (!st->ok)
+		return;
+
+	fprintf(stdout, "rtt min/avg/max = %.3f/%.3f/%.3f ms\n",
+		st->rtt_min / 1000.0, (double)st->rtt_sum / st->ok / 1000.0,
+		st->rtt_max / 1000.0);
+	fprintf(stdout, "rtt p50/p90/p99/p99.9 = %.3f/%.3f/%.3f/%.3f ms\n",
+		stats_percentile(st, 0.5), stats_percentile(st, 0.9),
+		stats_percentile(st, 0.99), stats_percentile(st, 0.999));
+}
+
+static int map_cmp(const void *a, const void *b)
+{
+	uint64_t sa = le64toh(((const struct trace_map *)a)->hdr->start_us);
+	uint64_t sb = le64toh(((const struct trace_map *)b)->hdr->start_us);
+
+	if (sa == sb)
+		return 0;
+	return sa < sb ? -1 : 1;
+}
+
+/* Seconds as plain digits, from 1 up to BUCKET_MAX_S */
+static int parse_bucket(const char *arg, uint64_t *us)
+{
+	unsigned long long v;
+	char *end;
+
+	if (*arg < '0' || *arg > '9')
+		return -1;
+
+	errno = 0;
+	v = strtoull(arg, &end, 10);
+	if (errno || *end || !v || v > BUCKET_MAX_S)
+		return -1;
+
+	*us = v * 1000000;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace_stats *total, *bucket;
+	struct trace_map *maps;
+	struct trace_columns cols;
+	const struct trace_block *block;
+	uint64_t bucket_us = 0, cur_bucket = 0, b, blk;
+	uint32_t i, from, count, block_records;
+	bool have_bucket = false;
+	int c, f, files, ret;
+
+	while (1) {
+#ifdef HAVE_GETOPT_LONG
+		int opt_idx = -1;
+		c = getopt_long(argc, argv, "b:vh", trace_long_opts, &opt_idx);
+#else
+		c = getopt(argc, argv, "b:vh");
+#endif
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'b':
+			if (parse_bucket(optarg, &bucket_us)) {
+				printf("Bucket must be 1 to %llu seconds.\n",
+				       BUCKET_MAX_S);
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'v':
+			fprintf(stdout, "wpan-trace 0.1\n");
+			return 1;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	files = argc - optind;
+	if (files < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	maps = calloc(files, sizeof(*maps));
+	total = malloc(sizeof(*total));
+	bucket = malloc(sizeof(*bucket));
+	if (!maps || !total || !bucket) {
+		fprintf(stderr, "Out of memory.\n");
+		return 1;
+	}
+
+	for (f = 0; f < files; f++) {
+		ret = trace_map_open(argv[optind + f], &maps[f]);
+		if (ret) {
+			fprintf(stderr, "%s: %s\n", argv[optind + f],
+				ret == -EINVAL ? "not a wpan-ping trace" : strerror(-ret));
+			return 1;
+		}
+	}
+
+	/* Traces of consecutive runs are analyzed in time order */
+	qsort(maps, files, sizeof(*maps), map_cmp);
+
+	stats_reset(total);
+	stats_reset(bucket);
+	if (bucket_us)
+		print_bucket_header();
+
+	for (f = 0; f < files; f++) {
+		block_records = le32toh(maps[f].hdr->block_records);
+		for (blk = 0; blk < maps[f].num_blocks; blk++) {
+			block = trace_map_block(&maps[f], blk);
+			count = le32toh(block->count);
+			if (count > block_records)
+				count = block_records;
+			trace_block_columns(block, block_records, &cols);
+
+			if (!bucket_us) {
+				stats_scan(total, &cols, 0, count);
+				continue;
+			}
+
+			/* Split the block where the time bucket changes */
+			for (from = 0, i = 0; i < count; i++) {
+				b = le64toh(cols.tx_us[i]) / bucket_us;
+				if (have_bucket && b == cur_bucket)
+					continue;
+				if (have_bucket) {
+					stats_scan(bucket, &cols, from, i);
+					print_bucket(cur_bucket * bucket_us, bucket);
+					stats_merge(total, bucket);
+					stats_reset(bucket);
+				}
+				have_bucket = true;
+				cur_bucket = b;
+				from = i;
+			}
+			stats_scan(bucket, &cols, from, count);
+		}
+	}
+
+	if (have_bucket && bucket->probes) {
+		print_bucket(cur_bucket * bucket_us, bucket);
+		stats_merge(total, bucket);
+	}
+
+	print_summary(total, files);
+
+	for (f = 0; f < files; f++)
+		trace_map_close(&maps[f]);
+	free(maps);
+	free(total);
+	free(bucket);
+	return 0;
+}
@@ -0,0 +1,497 @@
+/*
+ * Frame filter expressions of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+/* Deepest nesting of the evaluation stack, one bit per level */
+#define FILTER_MAX_DEPTH 64
+
+enum filter_op {
+	OP_TEST,
+	OP_AND,
+	OP_OR,
+	OP_NOT,
+};
+
+enum filter_cmp {
+	CMP_EQ,
+	CMP_NE,
+	CMP_LT,
+	CMP_LE,
+	CMP_GT,
+	CMP_GE,
+};
+
+enum filter_field {
+	FIELD_TYPE,
+	FIELD_VERSION,
+	FIELD_SEQ,
+	FIELD_LEN,
+	FIELD_PAN,
+	FIELD_DST_PAN,
+	FIELD_SRC_PAN,
+	FIELD_SRC,
+	FIELD_DST,
+	FIELD_ADDR,
+	FIELD_SECURITY,
+	FIELD_ACK_REQ,
+	FIELD_PENDING,
+};
+
+enum filter_kind {
+	KIND_NUM,	/* any comparison against a number */
+	KIND_TYPE,	/* a number or a frame type name */
+	KIND_FLAG,	/* a frame control bit, alone it tests for being set */
+	KIND_ADDR,	/* == and != against a short or extended address */
+};
+
+static const struct {
+	const char *name;
+	uint8_t field;
+	uint8_t kind;
+} filter_fields[] = {
+	{ "type", FIELD_TYPE, KIND_TYPE },
+	{ "version", FIELD_VERSION, KIND_NUM },
+	{ "seq", FIELD_SEQ, KIND_NUM },
+	{ "len", FIELD_LEN, KIND_NUM },
+	{ "pan", FIELD_PAN, KIND_ADDR },
+	{ "dst.pan", FIELD_DST_PAN, KIND_NUM },
+	{ "src.pan", FIELD_SRC_PAN, KIND_NUM },
+	{ "src", FIELD_SRC, KIND_ADDR },
+	{ "dst", FIELD_DST, KIND_ADDR },
+	{ "addr", FIELD_ADDR, KIND_ADDR },
+	{ "security", FIELD_SECURITY, KIND_FLAG },
+	{ "ackreq", FIELD_ACK_REQ, KIND_FLAG },
+	{ "pending", FIELD_PENDING, KIND_FLAG },
+};
+
+struct filter_insn {
+	uint8_t op;
+	uint8_t field;
+	uint8_t cmp;
+	uint8_t addr_type;
+	uint64_t value;
+};
+
+struct filter {
+	unsigned int len;
+	struct filter_insn insns[];
+};
+
+enum token {
+	TOK_END,
+	TOK_LPAREN,
+	TOK_RPAREN,
+	TOK_NOT,
+	TOK_AND,
+	TOK_OR,
+	TOK_CMP,
+	TOK_WORD,
+	TOK_BAD,
+};
+
+struct parser {
+	const char *s;		/* next character to tokenize */
+	const char *tok;	/* start of the current token */
+	size_t toklen;
+	int token;
+	uint8_t cmp;
+	struct filter_insn *insns;
+	unsigned int len;
+	unsigned int size;
+	unsigned int depth;
+};
+
+static bool is_word_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '.' || c == ':';
+}
+
+static bool token_is(const struct parser *p, const char *word)
+{
+	return p->toklen == strlen(word) && !strncmp(p->tok, word, p->toklen);
+}
+
+static void next_token(struct parser *p)
+{
+	const char *s = p->s;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	p->tok = s;
+
+	if (!*s) {
+		p->token = TOK_END;
+	} else if (*s == '(' || *s == ')') {
+		p->token = *s++ == '(' ? TOK_LPAREN : TOK_RPAREN;
+	} else if (!strncmp(s, "&&", 2) || !strncmp(s, "||", 2)) {
+		p->token = *s == '&' ? TOK_AND : TOK_OR;
+		s += 2;
+	} else if (!strncmp(s, "!=", 2)) {
+		p->token = TOK_CMP;
+		p->cmp = CMP_NE;
+		s += 2;
+	} else if (*s == '!') {
+		p->token = TOK_NOT;
+		s++;
+	} else if (*s == '=') {
+		p->token = TOK_CMP;
+		p->cmp = CMP_EQ;
+		s += s[1] == '=' ? 2 : 1;
+	} else if (*s == '<' || *s == '>') {
+		p->token = TOK_CMP;
+		p->cmp = *s == '<' ? (s[1] == '=' ? CMP_LE : CMP_LT) :
+				     (s[1] == '=' ? CMP_GE : CMP_GT);
+		s += s[1] == '=' ? 2 : 1;
+	} else if (is_word_char(*s)) {
+		while (is_word_char(*s))
+			s++;
+		p->token = TOK_WORD;
+	} else {
+		p->token = TOK_BAD;
+	}
+
+	p->s = s;
+	p->toklen = s - p->tok;
+	if (p->token == TOK_WORD) {
+		if (token_is(p, "and"))
+			p->token = TOK_AND;
+		else if (token_is(p, "or"))
+			p->token = TOK_OR;
+		else if (token_is(p, "not"))
+			p->token = TOK_NOT;
+	}
+}
+
+static int emit(struct parser *p, const struct filter_insn *insn)
+{
+	struct filter_insn *insns;
+
+	if (p->len == p->size) {
+		p->size = p->size ? p->size * 2 : 16;
+		insns = realloc(p->insns, p->size * sizeof(*insns));
+		if (!insns)
+			return -1;
+		p->insns = insns;
+	}
+	p->insns[p->len++] = *insn;
+
+	/* Tests push a result, the binary operators fold two into one */
+	if (insn->op == OP_TEST && ++p->depth > FILTER_MAX_DEPTH)
+		return -1;
+	if (insn->op == OP_AND || insn->op == OP_OR)
+		p->depth--;
+	return 0;
+}
+
+static int emit_op(struct parser *p, uint8_t op)
+{
+	struct filter_insn insn = { .op = op };
+
+	return emit(p, &insn);
+}
+
+static int parse_number(const struct parser *p, uint64_t max, uint64_t *value)
+{
+	char *end;
+
+	if (!isdigit((unsigned char)*p->tok))
+		return -1;
+	*value = strtoull(p->tok, &end, 0);
+	return end == p->tok + p->toklen && *value <= max ? 0 : -1;
+}
+
+static int parse_addr(const struct parser *p, struct filter_insn *insn)
+{
+	unsigned int b[IEEE802154_ADDR_LEN];
+	int i, n;
+
+	if (p->toklen == 23 &&
+	    sscanf(p->tok, "%2x:%2x:%2x:%2x:%2x:%2x:%2x:%2x%n", &b[0], &b[1], &b[2],
+		   &b[3], &b[4], &b[5], &b[6], &b[7], &n) == 8 && n == 23) {
+		insn->addr_type = IEEE802154_ADDR_LONG;
+		insn->value = 0;
+		for (i = 0; i < IEEE802154_ADDR_LEN; i++)
+			insn->value = insn->value << 8 | b[i];
+		return 0;
+	}
+
+	insn->addr_type = IEEE802154_ADDR_SHORT;
+	return parse_number(p, 0xffff, &insn->value);
+}
+
+static int parse_value(const struct parser *p, uint8_t kind,
+		       struct filter_insn *insn)
+{
+	unsigned int i;
+
+	if (p->token != TOK_WORD)
+		return -1;
+
+	switch (kind) {
+	case KIND_TYPE:
+		for (i = 0; i <= MAC_FC_TYPE; i++) {
+			if (token_is(p, mac_type_name(i))) {
+				insn->value = i;
+				return 0;
+			}
+		}
+		return parse_number(p, MAC_FC_TYPE, &insn->value);
+	case KIND_ADDR:
+		/* PAN IDs share the kind, they are short addresses in all but name */
+		if (insn->field == FIELD_PAN) {
+			insn->addr_type = IEEE802154_ADDR_SHORT;
+			return parse_number(p, 0xffff, &insn->value);
+		}
+		return parse_addr(p, insn);
+	default:
+		return parse_number(p, UINT64_MAX, &insn->value);
+	}
+}
+
+static int parse_test(struct parser *p)
+{
+	struct filter_insn insn = { .op = OP_TEST, .cmp = CMP_EQ };
+	unsigned int i;
+	uint8_t kind;
+
+	for (i = 0; i < sizeof(filter_fields) / sizeof(filter_fields[0]); i++)
+		if (token_is(p, filter_fields[i].name))
+			break;
+	if (i == sizeof(filter_fields) / sizeof(filter_fields[0]))
+		return -1;
+	insn.field = filter_fields[i].field;
+	kind = filter_fields[i].kind;
+	next_token(p);
+
+	if (p->token == TOK_CMP) {
+		insn.cmp = p->cmp;
+		if (kind == KIND_ADDR && insn.cmp != CMP_EQ && insn.cmp != CMP_NE)
+			return -1;
+		next_token(p);
+	} else if (kind == KIND_FLAG && p->token != TOK_WORD) {
+		/* A bare flag, "security" is "security != 0" */
+		insn.cmp = CMP_NE;
+		insn.value = 0;
+		return emit(p, &insn);
+	}
+
+	if (parse_value(p, kind, &insn))
+		return -1;
+	next_token(p);
+	return emit(p, &insn);
+}
+
+static int parse_or(struct parser *p);
+
+static int parse_unary(struct parser *p)
+{
+	switch (p->token) {
+	case TOK_NOT:
+		next_token(p);
+		return parse_unary(p) || emit_op(p, OP_NOT);
+	case TOK_LPAREN:
+		next_token(p);
+		if (parse_or(p) || p->token != TOK_RPAREN)
+			return -1;
+		next_token(p);
+		return 0;
+	case TOK_WORD:
+		return parse_test(p);
+	default:
+		return -1;
+	}
+}
+
+static int parse_and(struct parser *p)
+{
+	if (parse_unary(p))
+		return -1;
+	while (p->token == TOK_AND) {
+		next_token(p);
+		if (parse_unary(p) || emit_op(p, OP_AND))
+			return -1;
+	}
+	return 0;
+}
+
+static int parse_or(struct parser *p)
+{
+	if (parse_and(p))
+		return -1;
+	while (p->token == TOK_OR) {
+		next_token(p);
+		if (parse_and(p) || emit_op(p, OP_OR))
+			return -1;
+	}
+	return 0;
+}
+
+struct filter *filter_compile(const char *expr, const char **err)
+{
+	struct parser p;
+	struct filter *f;
+
+	memset(&p, 0, sizeof(p));
+	p.s = expr;
+	next_token(&p);
+
+	if (parse_or(&p) || p.token != TOK_END) {
+		*err = p.tok;
+		free(p.insns);
+		return NULL;
+	}
+
+	f = malloc(sizeof(*f) + p.len * sizeof(f->insns[0]));
+	if (f) {
+		f->len = p.len;
+		memcpy(f->insns, p.insns, p.len * sizeof(f->insns[0]));
+	} else {
+		*err = expr;
+	}
+	free(p.insns);
+	return f;
+}
+
+void filter_free(struct filter *f)
+{
+	free(f);
+}
+
+static bool compare(uint8_t cmp, uint64_t a, uint64_t b)
+{
+	switch (cmp) {
+	case CMP_EQ:
+		return a == b;
+	case CMP_NE:
+		return a != b;
+	case CMP_LT:
+		return a < b;
+	case CMP_LE:
+		return a <= b;
+	case CMP_GT:
+		return a > b;
+	default:
+		return a >= b;
+	}
+}
+
+static bool addr_equal(const struct filter_insn *insn,
+		       const struct ieee802154_addr_sa *sa)
+{
+	uint64_t key = 0;
+	int i;
+
+	if (sa->addr_type != insn->addr_type)
+		return false;
+	if (sa->addr_type == IEEE802154_ADDR_SHORT)
+		return sa->short_addr == insn->value;
+	for (i = 0; i < IEEE802154_ADDR_LEN; i++)
+		key = key << 8 | sa->hwaddr[i];
+	return key == insn->value;
+}
+
+/*
+ * Tests on a field the frame does not carry are false whatever the
+ * comparison, "seq != 3" does not match a frame without a sequence number.
+ */
+static bool run_test(const struct filter_insn *insn, const struct mac_header *h,
+		     uint32_t len)
+{
+	bool hit;
+
+	switch (insn->field) {
+	case FIELD_TYPE:
+		return compare(insn->cmp, h->type, insn->value);
+	case FIELD_VERSION:
+		return compare(insn->cmp, h->version, insn->value);
+	case FIELD_SEQ:
+		return h->has_seq && compare(insn->cmp, h->seq, insn->value);
+	case FIELD_LEN:
+		return compare(insn->cmp, len, insn->value);
+	case FIELD_DST_PAN:
+		return h->has_dst_pan && compare(insn->cmp, h->dst.pan_id, insn->value);
+	case FIELD_SRC_PAN:
+		return h->has_src_pan && compare(insn->cmp, h->src.pan_id, insn->value);
+	case FIELD_PAN:
+		if (!h->has_dst_pan && !h->has_src_pan)
+			return false;
+		hit = (h->has_dst_pan && h->dst.pan_id == insn->value) ||
+		      (h->has_src_pan && h->src.pan_id == insn->value);
+		break;
+	case FIELD_SRC:
+		if (h->src.addr_type == IEEE802154_ADDR_NONE)
+			return false;
+		hit = addr_equal(insn, &h->src);
+		break;
+	case FIELD_DST:
+		if (h->dst.addr_type == IEEE802154_ADDR_NONE)
+			return false;
+		hit = addr_equal(insn, &h->dst);
+		break;
+	case FIELD_ADDR:
+		if (h->src.addr_type == IEEE802154_ADDR_NONE &&
+		    h->dst.addr_type == IEEE802154_ADDR_NONE)
+			return false;
+		hit = addr_equal(insn, &h->src) || addr_equal(insn, &h->dst);
+		break;
+	case FIELD_SECURITY:
+		return compare(insn->cmp, !!(h->fc & MAC_FC_SECURITY), insn->value);
+	case FIELD_ACK_REQ:
+		return compare(insn->cmp, !!(h->fc & MAC_FC_ACK_REQ), insn->value);
+	default:
+		return compare(insn->cmp, !!(h->fc & MAC_FC_PENDING), insn->value);
+	}
+
+	return insn->cmp == CMP_EQ ? hit : !hit;
+}
+
+bool filter_match(const struct filter *f, const struct mac_header *h,
+		  uint32_t len)
+{
+	const struct filter_insn *insn = f->insns, *end = f->insns + f->len;
+	uint64_t stack = 0, top;
+
+	/* Postfix program, the stack is a bit per level with the top in bit 0 */
+	for (; insn < end; insn++) {
+		switch (insn->op) {
+		case OP_TEST:
+			stack = stack << 1 | run_test(insn, h, len);
+			break;
+		case OP_NOT:
+			stack ^= 1;
+			break;
+		case OP_AND:
+			top = stack & stack >> 1 & 1;
+			stack = (stack >> 2) << 1 | top;
+			break;
+		case OP_OR:
+			top = (stack | stack >> 1) & 1;
+			stack = (stack >> 2) << 1 | top;
+			break;
+		}
+	}
+	return stack & 1;
+}
@@ -0,0 +1,38 @@
+/*
+ * Frame filter expressions of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_SNIFF_FILTER_H
+#define __WPAN_SNIFF_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mac.h"
+
+struct filter;
+
+/*
+ * Compiles an expression like "type data and pan 0xbeef and not src 0x0001"
+ * into a program run against every frame. On a syntax error NULL is returned
+ * and *err points into expr where parsing stopped.
+ */
+struct filter *filter_compile(const char *expr, const char **err);
+void filter_free(struct filter *f);
+/* len is the length of the frame on air */
+bool filter_match(const struct filter *f, const struct mac_header *h,
+		  uint32_t len);
+
+#endif /* __WPAN_SNIFF_FILTER_H */
@@ -0,0 +1,213 @@
+/*
+ * IEEE 802.15.4 MAC header decoder of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mac.h"
+
+#define MAC_VERSION_2015 2
+#define MAC_IE_HT1 0x7e
+#define MAC_IE_HT2 0x7f
+
+/*
+ * Everything that decides where the fields of a header are lives in the
+ * frame control bits 6, 8 and 10-15. They index a table filled once, so the
+ * per frame work is a lookup and a few loads.
+ */
+struct mac_layout {
+	uint8_t valid;
+	uint8_t seq;
+	uint8_t dst_pan;
+	uint8_t dst_mode;
+	uint8_t src_pan;
+	uint8_t src_mode;
+	uint8_t len; /* frame control up to the end of the addressing fields */
+};
+
+static struct mac_layout mac_layouts[256];
+
+/* Auxiliary security header length by key id mode and frame counter suppression */
+static const uint8_t mac_aux_len[8] = { 5, 6, 10, 14, 1, 2, 6, 10 };
+
+static const char *const mac_type_names[8] = {
+	"beacon", "data", "ack", "cmd", "reserved", "multipurpose", "fragment",
+	"extended",
+};
+
+static unsigned int mac_layout_index(uint16_t fc)
+{
+	return (fc >> MAC_FC_DST_SHIFT) << 2 | (fc >> 7 & 0x2) | (fc >> 6 & 0x1);
+}
+
+static unsigned int mac_addr_len(unsigned int mode)
+{
+	return mode == IEEE802154_ADDR_LONG ? IEEE802154_ADDR_LEN :
+	       mode == IEEE802154_ADDR_SHORT ? 2 : 0;
+}
+
+static void mac_fill_layout(struct mac_layout *l, unsigned int idx)
+{
+	unsigned int comp = idx & 1, seq_suppress = idx >> 1 & 1;
+	unsigned int dst = idx >> 2 & 3, version = idx >> 4 & 3, src = idx >> 6 & 3;
+
+	l->valid = dst != 1 && src != 1 && version != 3;
+	l->dst_mode = dst;
+	l->src_mode = src;
+	l->seq = !(version == MAC_VERSION_2015 && seq_suppress);
+
+	if (version != MAC_VERSION_2015) {
+		/* 2003/2006: a PAN ID per address, compression drops the source one */
+		l->dst_pan = !!dst;
+		l->src_pan = src && !(comp && dst);
+	} else if (dst == IEEE802154_ADDR_LONG && src == IEEE802154_ADDR_LONG) {
+		l->dst_pan = !comp;
+		l->src_pan = 0;
+	} else if (dst && src) {
+		l->dst_pan = 1;
+		l->src_pan = !comp;
+	} else {
+		/* Only one address or none, table 7-2 of 802.15.4-2015 */
+		l->dst_pan = dst ? !comp : (!src && comp);
+		l->src_pan = src && !comp;
+	}
+
+	l->len = 2 + l->seq + 2 * l->dst_pan + mac_addr_len(dst) +
+		 2 * l->src_pan + mac_addr_len(src);
+}
+
+void mac_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(mac_layouts) / sizeof(mac_layouts[0]); i++)
+		mac_fill_layout(&mac_layouts[i], i);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static const uint8_t *get_addr(const uint8_t *p, unsigned int mode,
+			       struct ieee802154_addr_sa *sa)
+{
+	int i;
+
+	sa->addr_type = mode;
+	if (mode == IEEE802154_ADDR_SHORT) {
+		sa->short_addr = get_le16(p);
+		return p + 2;
+	}
+	if (mode == IEEE802154_ADDR_LONG) {
+		/* Little endian on air, the socket address keeps it the other way round */
+		for (i = 0; i < IEEE802154_ADDR_LEN; i++)
+			sa->hwaddr[i] = p[IEEE802154_ADDR_LEN - 1 - i];
+		return p + IEEE802154_ADDR_LEN;
+	}
+	return p;
+}
+
+int mac_decode(const uint8_t *data, size_t len, unsigned int fcs_len,
+	       struct mac_header *h)
+{
+	const struct mac_layout *l;
+	const uint8_t *p, *end;
+	uint16_t ie;
+
+	memset(h, 0, sizeof(*h));
+	if (len < 2 + fcs_len)
+		return -1;
+	end = data + len - fcs_len;
+
+	h->fc = get_le16(data);
+	h->type = h->fc & MAC_FC_TYPE;
+	h->version = h->fc >> MAC_FC_VERSION_SHIFT & 3;
+	p = data + 2;
+
+	/* The newer frame types have a frame control of their own, only name them */
+	if (h->type >= MAC_FRAME_RESERVED)
+		goto out;
+
+	l = &mac_layouts[mac_layout_index(h->fc)];
+	if (!l->valid || end - data < l->len)
+		return -1;
+
+	if (l->seq) {
+		h->has_seq = true;
+		h->seq = *p++;
+	}
+	if (l->dst_pan) {
+		h->has_dst_pan = true;
+		h->dst.pan_id = get_le16(p);
+		p += 2;
+	}
+	p = get_addr(p, l->dst_mode, &h->dst);
+	if (l->src_pan) {
+		h->has_src_pan = true;
+		h->src.pan_id = get_le16(p);
+		p += 2;
+	} else if (l->src_mode && l->dst_pan) {
+		h->has_src_pan = true;
+		h->src.pan_id = h->dst.pan_id;
+	}
+	p = get_addr(p, l->src_mode, &h->src);
+
+	if (h->fc & MAC_FC_SECURITY) {
+		if (p >= end || end - p < mac_aux_len[*p >> 3 & 7])
+			return -1;
+		p += mac_aux_len[*p >> 3 & 7];
+	}
+
+	/* Header IEs run up to a termination IE or the end of the frame */
+	if (h->fc & MAC_FC_IE_PRESENT && h->version == MAC_VERSION_2015) {
+		while (end - p >= 2) {
+			ie = get_le16(p);
+			p += 2 + (ie & 0x7f);
+			if (p > end)
+				return -1;
+			if ((ie >> 7 & 0xff) == MAC_IE_HT1 || (ie >> 7 & 0xff) == MAC_IE_HT2)
+				break;
+		}
+	}
+
+out:
+	h->hdr_len = p - data;
+	h->payload_len = end - p;
+	return 0;
+}
+
+const char *mac_type_name(uint8_t type)
+{
+	return mac_type_names[type & MAC_FC_TYPE];
+}
+
+void mac_format_addr(char *buf, const struct ieee802154_addr_sa *sa)
+{
+	const uint8_t *a = sa->hwaddr;
+
+	if (sa->addr_type == IEEE802154_ADDR_LONG)
+		snprintf(buf, 24, "%02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x",
+			 a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+	else if (sa->addr_type == IEEE802154_ADDR_SHORT)
+		snprintf(buf, 24, "0x%04x", sa->short_addr);
+	else
+		snprintf(buf, 24, "-");
+}
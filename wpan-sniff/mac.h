@@ -0,0 +1,80 @@
+/*
+ * IEEE 802.15.4 MAC header decoder of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_SNIFF_MAC_H
+#define __WPAN_SNIFF_MAC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "addr.h"
+
+enum {
+	MAC_FRAME_BEACON = 0,
+	MAC_FRAME_DATA = 1,
+	MAC_FRAME_ACK = 2,
+	MAC_FRAME_CMD = 3,
+	MAC_FRAME_RESERVED = 4,
+	MAC_FRAME_MULTIPURPOSE = 5,
+	MAC_FRAME_FRAGMENT = 6,
+	MAC_FRAME_EXTENDED = 7,
+};
+
+#define MAC_FC_TYPE 0x0007
+#define MAC_FC_SECURITY 0x0008
+#define MAC_FC_PENDING 0x0010
+#define MAC_FC_ACK_REQ 0x0020
+#define MAC_FC_PANID_COMP 0x0040
+#define MAC_FC_SEQ_SUPPRESS 0x0100
+#define MAC_FC_IE_PRESENT 0x0200
+#define MAC_FC_DST_SHIFT 10
+#define MAC_FC_VERSION_SHIFT 12
+#define MAC_FC_SRC_SHIFT 14
+
+/*
+ * A decoded header. Addresses use the socket representation: host order
+ * short address and PAN ID, extended addresses most significant byte first.
+ * A compressed source PAN ID is filled in from the destination.
+ */
+struct mac_header {
+	uint16_t fc;
+	uint8_t type;
+	uint8_t version;
+	bool has_seq;
+	bool has_dst_pan;
+	bool has_src_pan;
+	uint8_t seq;
+	struct ieee802154_addr_sa dst;
+	struct ieee802154_addr_sa src;
+	uint16_t hdr_len; /* including the auxiliary security header and header IEs */
+	uint16_t payload_len;
+};
+
+/* Fills the layout tables, call once before the first mac_decode */
+void mac_init(void);
+
+/*
+ * Decodes the header of a frame of len bytes, fcs_len of which are the
+ * trailing FCS. Returns 0 or -1 for a truncated or reserved layout.
+ */
+int mac_decode(const uint8_t *data, size_t len, unsigned int fcs_len,
+	       struct mac_header *h);
+const char *mac_type_name(uint8_t type);
+/* Formats an address for printing, buf must hold 24 bytes */
+void mac_format_addr(char *buf, const struct ieee802154_addr_sa *sa);
+
+#endif /* __WPAN_SNIFF_MAC_H */
@@ -0,0 +1,196 @@
+/*
+ * Zero-copy pcapng writer of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "pcapng.h"
+
+/* Enhanced packet block up to the packet data */
+struct epb_head {
+	uint32_t type;
+	uint32_t total_len;
+	uint32_t iface;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+/* Padding of the data to 32 bits followed by the trailing total length */
+struct epb_tail {
+	uint8_t pad[4];
+	uint32_t total_len;
+};
+
+/*
+ * Each frame becomes three iovecs: a header built here, the frame itself
+ * where it lies in the capture ring and the padding with the trailer.
+ * One writev moves the whole batch.
+ */
+struct pcapng_writer {
+	int fd;
+	unsigned int n;
+	struct epb_head heads[PCAPNG_BATCH];
+	struct epb_tail tails[PCAPNG_BATCH];
+	struct iovec iov[PCAPNG_BATCH * 3];
+};
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+struct pcapng_writer *pcapng_open(const char *path, const char *ifname,
+				  uint16_t linktype)
+{
+	uint8_t block[PCAPNG_HEADERS_MAX];
+	struct pcapng_writer *w;
+	size_t len;
+	int err;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return NULL;
+
+	if (!strcmp(path, "-"))
+		w->fd = STDOUT_FILENO;
+	else
+		w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (w->fd < 0) {
+		free(w);
+		return NULL;
+	}
+
+	/* Timestamps in ns, as the ring hands them up */
+	len = write_headers(block, "wpan-sniff", ifname, linktype, 9);
+	err = write_all(w->fd, block, len);
+	if (err) {
+		if (w->fd != STDOUT_FILENO)
+			close(w->fd);
+		free(w);
+		errno = -err;
+		return NULL;
+	}
+
+	return w;
+}
+
+int pcapng_add(struct pcapng_writer *w, uint64_t ts_ns, const void *data,
+	       uint32_t caplen, uint32_t len)
+{
+	struct epb_head *head;
+	struct epb_tail *tail;
+	struct iovec *iov;
+	uint32_t pad = (4 - (caplen & 3)) & 3;
+	int ret;
+
+	if (w->n == PCAPNG_BATCH) {
+		ret = pcapng_flush(w);
+		if (ret)
+			return ret;
+	}
+
+	head = &w->heads[w->n];
+	tail = &w->tails[w->n];
+	iov = &w->iov[w->n * 3];
+
+	head->type = PCAPNG_EPB;
+	head->total_len = sizeof(*head) + caplen + pad + sizeof(tail->total_len);
+	head->iface = 0;
+	head->ts_high = ts_ns >> 32;
+	head->ts_low = ts_ns & 0xffffffff;
+	head->caplen = caplen;
+	head->len = len;
+	memset(tail->pad, 0, sizeof(tail->pad));
+	tail->total_len = head->total_len;
+
+	iov[0].iov_base = head;
+	iov[0].iov_len = sizeof(*head);
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = caplen;
+	iov[2].iov_base = tail->pad + sizeof(tail->pad) - pad;
+	iov[2].iov_len = pad + sizeof(tail->total_len);
+
+	w->n++;
+	return 0;
+}
+
+int pcapng_flush(struct pcapng_writer *w)
+{
+	struct iovec *iov = w->iov;
+	int cnt = w->n * 3;
+	ssize_t ret;
+
+	while (cnt) {
+		ret = writev(w->fd, iov, cnt);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			w->n = 0;
+			return -errno;
+		}
+
+		/* Short write, skip what went out and retry the rest */
+		while (cnt && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	w->n = 0;
+	return 0;
+}
+
+int pcapng_close(struct pcapng_writer *w)
+{
+	int ret;
+
+	if (!w)
+		return 0;
+
+	ret = pcapng_flush(w);
+	if (w->fd != STDOUT_FILENO && close(w->fd) && !ret)
+		ret = -errno;
+	free(w);
+	return ret;
+}
@@ -0,0 +1,41 @@
+/*
+ * Zero-copy pcapng writer of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_SNIFF_PCAPNG_H
+#define __WPAN_SNIFF_PCAPNG_H
+
+#include <stdint.h>
+
+#include "pcapng-block.h"
+
+/* Frames gathered into one writev, three iovecs each */
+#define PCAPNG_BATCH 256
+
+struct pcapng_writer;
+
+/* "-" writes to stdout, timestamps are in ns */
+struct pcapng_writer *pcapng_open(const char *path, const char *ifname,
+				  uint16_t linktype);
+/*
+ * Queues a frame without copying it, the data must stay valid until the
+ * next pcapng_flush, which the writer also does by itself when full.
+ */
+int pcapng_add(struct pcapng_writer *w, uint64_t ts_ns, const void *data,
+	       uint32_t caplen, uint32_t len);
+int pcapng_flush(struct pcapng_writer *w);
+int pcapng_close(struct pcapng_writer *w);
+
+#endif /* __WPAN_SNIFF_PCAPNG_H */
@@ -0,0 +1,228 @@
+/*
+ * TPACKET_V3 receive ring of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#include "ring.h"
+
+/*
+ * The kernel fills whole blocks of frames and flips their status to
+ * TP_STATUS_USER. Frames are read in place and the block is given back in
+ * one go, nothing is copied out of the mapping.
+ */
+struct ring {
+	int fd;
+	int hwtype;
+	uint8_t *map;
+	size_t map_len;
+	unsigned int block_size;
+	unsigned int blocks;
+	unsigned int cur;
+	struct tpacket_block_desc *block;
+	struct tpacket3_hdr *pkt;
+	uint32_t left;
+	struct ring_stats stats;
+};
+
+static int ring_bind(struct ring *r, const char *ifname)
+{
+	struct sockaddr_ll sll;
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	if (ioctl(r->fd, SIOCGIFHWADDR, &ifr))
+		return -errno;
+	r->hwtype = ifr.ifr_hwaddr.sa_family;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = if_nametoindex(ifname);
+	if (!sll.sll_ifindex)
+		return -ENODEV;
+
+	if (bind(r->fd, (struct sockaddr *)&sll, sizeof(sll)))
+		return -errno;
+	return 0;
+}
+
+struct ring *ring_open(const char *ifname, unsigned int block_size,
+		       unsigned int blocks)
+{
+	struct tpacket_req3 req;
+	int version = TPACKET_V3;
+	struct ring *r;
+	int err;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	/*
+	 * Protocol 0 receives nothing until ring_bind sets ETH_P_ALL on the
+	 * interface, so frames of other interfaces never reach the ring
+	 */
+	r->fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (r->fd < 0)
+		goto err_free;
+
+	if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)))
+		goto err_close;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = block_size;
+	req.tp_block_nr = blocks;
+	/* Only used by the kernel to check the geometry, frames are packed */
+	req.tp_frame_size = 2048;
+	req.tp_frame_nr = (block_size / req.tp_frame_size) * blocks;
+	req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT_MS;
+	if (setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)))
+		goto err_close;
+
+	r->block_size = block_size;
+	r->blocks = blocks;
+	r->map_len = (size_t)block_size * blocks;
+	r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_POPULATE, r->fd, 0);
+	if (r->map == MAP_FAILED)
+		goto err_close;
+
+	err = ring_bind(r, ifname);
+	if (err) {
+		munmap(r->map, r->map_len);
+		close(r->fd);
+		free(r);
+		errno = -err;
+		return NULL;
+	}
+
+	return r;
+
+err_close:
+	err = errno;
+	close(r->fd);
+	errno = err;
+err_free:
+	free(r);
+	return NULL;
+}
+
+void ring_close(struct ring *r)
+{
+	if (!r)
+		return;
+
+	munmap(r->map, r->map_len);
+	close(r->fd);
+	free(r);
+}
+
+int ring_fd(const struct ring *r)
+{
+	return r->fd;
+}
+
+int ring_hwtype(const struct ring *r)
+{
+	return r->hwtype;
+}
+
+static struct tpacket_block_desc *ring_block(struct ring *r, unsigned int i)
+{
+	return (struct tpacket_block_desc *)(r->map + (size_t)i * r->block_size);
+}
+
+int ring_wait(struct ring *r, int timeout_ms)
+{
+	struct tpacket_block_desc *bd = ring_block(r, r->cur);
+	struct pollfd pfd = { .fd = r->fd, .events = POLLIN | POLLERR };
+	int ret;
+
+	while (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+		 TP_STATUS_USER)) {
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0)
+			return -errno;
+		if (!ret)
+			return 0;
+	}
+
+	r->block = bd;
+	r->left = bd->hdr.bh1.num_pkts;
+	r->pkt = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+	return r->left;
+}
+
+int ring_next(struct ring *r, struct ring_frame *f)
+{
+	struct tpacket3_hdr *pkt = r->pkt;
+
+	if (!r->left)
+		return 0;
+
+	f->data = (const uint8_t *)pkt + pkt->tp_mac;
+	f->caplen = pkt->tp_snaplen;
+	f->len = pkt->tp_len;
+	f->ts_ns = (uint64_t)pkt->tp_sec * 1000000000ULL + pkt->tp_nsec;
+
+	if (--r->left)
+		r->pkt = (struct tpacket3_hdr *)((uint8_t *)pkt + pkt->tp_next_offset);
+	return 1;
+}
+
+void ring_release(struct ring *r)
+{
+	if (!r->block)
+		return;
+
+	__atomic_store_n(&r->block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+			 __ATOMIC_RELEASE);
+	r->block = NULL;
+	r->left = 0;
+	r->cur = (r->cur + 1) % r->blocks;
+}
+
+int ring_stats(struct ring *r, struct ring_stats *st)
+{
+	struct tpacket_stats_v3 kst;
+	socklen_t len = sizeof(kst);
+
+	/* Reading the counters resets them in the kernel */
+	if (getsockopt(r->fd, SOL_PACKET, PACKET_STATISTICS, &kst, &len))
+		return -errno;
+
+	r->stats.packets += kst.tp_packets;
+	r->stats.drops += kst.tp_drops;
+	r->stats.freezes += kst.tp_freeze_q_cnt;
+	*st = r->stats;
+	return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * TPACKET_V3 receive ring of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_SNIFF_RING_H
+#define __WPAN_SNIFF_RING_H
+
+#include <stdint.h>
+
+#define RING_BLOCK_SIZE (256 * 1024)
+#define RING_BLOCKS 16
+/* A block is handed to user space at the latest after this many ms */
+#define RING_BLOCK_TIMEOUT_MS 100
+
+/* One captured frame, data points into the ring and lives as long as its block */
+struct ring_frame {
+	const uint8_t *data;
+	uint32_t caplen;
+	uint32_t len;
+	uint64_t ts_ns;
+};
+
+struct ring_stats {
+	uint64_t packets;
+	uint64_t drops;
+	uint64_t freezes;
+};
+
+struct ring;
+
+struct ring *ring_open(const char *ifname, unsigned int block_size,
+		       unsigned int blocks);
+void ring_close(struct ring *r);
+int ring_fd(const struct ring *r);
+/* ARPHRD_* type of the interface */
+int ring_hwtype(const struct ring *r);
+
+/*
+ * Waits up to timeout_ms for the next block the kernel retired. Returns the
+ * number of frames in it, 0 on timeout and a negative errno on error. The
+ * frames are read with ring_next and stay valid until ring_release.
+ */
+int ring_wait(struct ring *r, int timeout_ms);
+int ring_next(struct ring *r, struct ring_frame *f);
+void ring_release(struct ring *r);
+
+/* Kernel counters, accumulated since the ring was opened */
+int ring_stats(struct ring *r, struct ring_stats *st);
+
+#endif /* __WPAN_SNIFF_RING_H */
@@ -0,0 +1,275 @@
+/*
+ * Channel survey of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "phyctl.h"
+#include "freq.h"
+#include "survey.h"
+
+#define SURVEY_MAX_PANS 32
+/* Preamble, SFD and PHR go on air in front of every PSDU */
+#define SURVEY_PHY_OVERHEAD 6
+#define SURVEY_FCS_LEN 2
+
+struct survey_channel {
+	uint8_t page;
+	uint8_t channel;
+	uint32_t byte_ns;
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t airtime_ns;
+	uint64_t listen_ns;
+	uint16_t pans[SURVEY_MAX_PANS];
+	unsigned int num_pans;
+	bool more_pans;
+};
+
+struct survey {
+	struct phyctl *pc;
+	struct survey_channel *chans;
+	unsigned int num_chans;
+	unsigned int dwell_ms;
+	unsigned int rounds;
+	unsigned int round;
+	/*
+	 * The ring hands frames up to a block timeout late, so frames are
+	 * booked by timestamp: to the current channel if stamped after its
+	 * retune, else to the one before. num_chans means none.
+	 */
+	unsigned int cur;
+	unsigned int prev;
+	uint64_t cur_start;
+	uint64_t prev_start;
+	uint64_t hop_at; /* monotonic */
+	uint8_t orig_page;
+	uint8_t orig_channel;
+};
+
+static uint64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Time on air of one PSDU byte, O-QPSK at 250 kb/s unless the page says otherwise */
+static uint32_t byte_time_ns(uint8_t page, uint8_t channel)
+{
+	if (page == 0 && channel == 0)
+		return 400000; /* BPSK 20 kb/s */
+	if (page == 0 && channel <= 10)
+		return 200000; /* BPSK 40 kb/s */
+	if (page == 2 && channel == 0)
+		return 80000; /* O-QPSK 100 kb/s */
+	return 32000;
+}
+
+struct survey *survey_open(const char *ifname, int page, unsigned int dwell_ms,
+			   unsigned int rounds)
+{
+	struct phy_caps caps;
+	struct survey *s;
+	unsigned int p, c, n = 0;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+
+	s->pc = phyctl_open(ifname);
+	if (!s->pc)
+		goto out_free;
+	if (phyctl_get_caps(s->pc, &caps) ||
+	    phyctl_get_channel(s->pc, &s->orig_page, &s->orig_channel))
+		goto out_close;
+
+	for (p = 0; p < PHYCTL_MAX_PAGES; p++)
+		if (page < 0 || (int)p == page)
+			n += __builtin_popcount(caps.channels[p]);
+	if (!n) {
+		fprintf(stderr, "%s advertises no channels to survey\n", ifname);
+		goto out_close;
+	}
+
+	s->chans = calloc(n, sizeof(*s->chans));
+	if (!s->chans)
+		goto out_close;
+
+	for (p = 0; p < PHYCTL_MAX_PAGES; p++) {
+		if (page >= 0 && (int)p != page)
+			continue;
+		for (c = 0; c < 32; c++) {
+			if (!(caps.channels[p] & 1U << c))
+				continue;
+			s->chans[s->num_chans].page = p;
+			s->chans[s->num_chans].channel = c;
+			s->chans[s->num_chans].byte_ns = byte_time_ns(p, c);
+			s->num_chans++;
+		}
+	}
+
+	s->dwell_ms = dwell_ms;
+	s->rounds = rounds;
+	s->cur = s->prev = s->num_chans;
+	return s;
+
+out_close:
+	phyctl_close(s->pc);
+out_free:
+	free(s);
+	return NULL;
+}
+
+void survey_close(struct survey *s)
+{
+	if (!s)
+		return;
+	phyctl_set_channel(s->pc, s->orig_page, s->orig_channel);
+	phyctl_close(s->pc);
+	free(s->chans);
+	free(s);
+}
+
+int survey_timeout(const struct survey *s)
+{
+	uint64_t now;
+
+	if (s->round == s->rounds && s->rounds)
+		return INT_MAX;
+	if (s->cur == s->num_chans)
+		return 0;
+
+	now = clock_ns(CLOCK_MONOTONIC);
+	if (now >= s->hop_at)
+		return 0;
+	/* Round up, waking a bit late beats spinning on the last millisecond */
+	return (s->hop_at - now + 999999) / 1000000;
+}
+
+/* Closes the dwell on the current channel at the ring time now */
+static void survey_leave(struct survey *s, uint64_t now)
+{
+	if (s->cur == s->num_chans)
+		return;
+	s->chans[s->cur].listen_ns += now - s->cur_start;
+	s->prev = s->cur;
+	s->prev_start = s->cur_start;
+	s->cur = s->num_chans;
+	s->cur_start = now;
+}
+
+int survey_hop(struct survey *s)
+{
+	unsigned int next;
+	uint64_t now;
+
+	if (s->cur == s->num_chans) {
+		next = s->prev == s->num_chans ? 0 : s->prev + 1;
+	} else {
+		next = s->cur + 1;
+	}
+	if (next == s->num_chans) {
+		s->round++;
+		next = 0;
+	}
+
+	now = clock_ns(CLOCK_REALTIME);
+	survey_leave(s, now);
+	if (s->rounds && s->round == s->rounds)
+		return 1;
+
+	if (phyctl_set_channel(s->pc, s->chans[next].page, s->chans[next].channel))
+		return -1;
+
+	s->cur = next;
+	s->cur_start = clock_ns(CLOCK_REALTIME);
+	s->hop_at = clock_ns(CLOCK_MONOTONIC) + s->dwell_ms * 1000000ULL;
+	return 0;
+}
+
+static void survey_add_pan(struct survey_channel *ch, uint16_t pan)
+{
+	unsigned int i;
+
+	if (pan == 0xffff)
+		return;
+	for (i = 0; i < ch->num_pans; i++)
+		if (ch->pans[i] == pan)
+			return;
+	if (ch->num_pans == SURVEY_MAX_PANS)
+		ch->more_pans = true;
+	else
+		ch->pans[ch->num_pans++] = pan;
+}
+
+void survey_account(struct survey *s, const struct ring_frame *f,
+		    const struct mac_header *h, bool decoded,
+		    unsigned int fcs_len)
+{
+	struct survey_channel *ch;
+	unsigned int idx;
+
+	if (f->ts_ns >= s->cur_start)
+		idx = s->cur;
+	else if (f->ts_ns >= s->prev_start)
+		idx = s->prev;
+	else
+		return;
+	if (idx == s->num_chans)
+		return;
+
+	ch = &s->chans[idx];
+	ch->frames++;
+	ch->bytes += f->len;
+	/* Without the FCS in the capture it still was on air */
+	ch->airtime_ns += (uint64_t)(f->len + SURVEY_PHY_OVERHEAD +
+				     (fcs_len ? 0 : SURVEY_FCS_LEN)) * ch->byte_ns;
+
+	if (decoded && h->has_src_pan)
+		survey_add_pan(ch, h->src.pan_id);
+	if (decoded && h->has_dst_pan)
+		survey_add_pan(ch, h->dst.pan_id);
+}
+
+void survey_report(struct survey *s, FILE *out)
+{
+	const struct survey_channel *ch;
+	unsigned int i;
+	double airtime;
+
+	survey_leave(s, clock_ns(CLOCK_REALTIME));
+
+	fprintf(out, "page chan      MHz   listen   frames     bytes  pans  airtime\n");
+	for (i = 0; i < s->num_chans; i++) {
+		ch = &s->chans[i];
+		airtime = ch->listen_ns ? 100.0 * ch->airtime_ns / ch->listen_ns : 0;
+		fprintf(out, "%4u %4u %8.1f %7.1fs %8llu %9llu %4u%s %7.2f%%\n",
+			ch->page, ch->channel,
+			ieee802154_channel_freq(ch->page, ch->channel),
+			ch->listen_ns / 1e9, (unsigned long long)ch->frames,
+			(unsigned long long)ch->bytes, ch->num_pans,
+			ch->more_pans ? "+" : " ", airtime);
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Channel survey of wpan-sniff
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_SNIFF_SURVEY_H
+#define __WPAN_SNIFF_SURVEY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ring.h"
+#include "mac.h"
+
+#define SURVEY_DWELL_MS 1000
+
+struct survey;
+
+/*
+ * Prepares a walk over the channels the phy behind ifname advertises, all
+ * pages or only the given one (-1 for all), rounds times (0 for ever).
+ */
+struct survey *survey_open(const char *ifname, int page, unsigned int dwell_ms,
+			   unsigned int rounds);
+/* Puts the phy back on the channel it was on */
+void survey_close(struct survey *s);
+
+/* Milliseconds left on the current channel, 0 when it is time to hop */
+int survey_timeout(const struct survey *s);
+/* Tunes to the next channel. Returns 1 after the last round, -1 on error */
+int survey_hop(struct survey *s);
+/* Books a frame on the channel it was received on, by its timestamp */
+void survey_account(struct survey *s, const struct ring_frame *f,
+		    const struct mac_header *h, bool decoded,
+		    unsigned int fcs_len);
+void survey_report(struct survey *s, FILE *out);
+
+#endif /* __WPAN_SNIFF_SURVEY_H */
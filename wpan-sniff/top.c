@@ -0,0 +1,272 @@
+/*
+ * Per PAN and per source traffic accounting of wpan-top
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "addr.h"
+#include "top.h"
+
+#define TOP_TABLE_MIN 64
+/* Slots looked at for the idlest source when the table is at its limit */
+#define TOP_EVICT_SAMPLE 32
+
+static unsigned int top_entry_hash(const struct top_entry *e, unsigned int size)
+{
+	return addr_hash(e->key, e->addr.addr_type, e->addr.pan_id, size);
+}
+
+static struct top_entry *top_slot(struct top_entry *slots, unsigned int size,
+				  uint64_t key, int type, uint16_t pan)
+{
+	unsigned int i = addr_hash(key, type, pan, size);
+
+	/* Linear probing, the table never fills up */
+	while (slots[i].used &&
+	       (slots[i].key != key || slots[i].addr.addr_type != type ||
+		slots[i].addr.pan_id != pan))
+		i = (i + 1) & (size - 1);
+	return &slots[i];
+}
+
+int top_table_init(struct top_table *t, unsigned int max)
+{
+	memset(t, 0, sizeof(*t));
+	t->slots = calloc(TOP_TABLE_MIN, sizeof(*t->slots));
+	if (!t->slots)
+		return -ENOMEM;
+	t->size = TOP_TABLE_MIN;
+	t->max = max;
+	return 0;
+}
+
+void top_table_free(struct top_table *t)
+{
+	free(t->slots);
+	t->slots = NULL;
+}
+
+static int top_table_grow(struct top_table *t)
+{
+	unsigned int i, size = t->size * 2;
+	struct top_entry *slots, *e;
+
+	slots = calloc(size, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+
+	for (i = 0; i < t->size; i++) {
+		if (!t->slots[i].used)
+			continue;
+		e = top_slot(slots, size, t->slots[i].key, t->slots[i].addr.addr_type,
+			     t->slots[i].addr.pan_id);
+		*e = t->slots[i];
+	}
+
+	free(t->slots);
+	t->slots = slots;
+	t->size = size;
+	return 0;
+}
+
+/*
+ * Backward shift deletion: later members of the probe chain move up into
+ * the hole unless their home slot lies between the hole and them, so no
+ * tombstones are left behind.
+ */
+static void top_remove(struct top_table *t, unsigned int hole)
+{
+	unsigned int mask = t->size - 1, i = hole, home;
+
+	for (i = (hole + 1) & mask; t->slots[i].used; i = (i + 1) & mask) {
+		home = top_entry_hash(&t->slots[i], t->size);
+		if (hole <= i ? (home > hole && home <= i) : (home > hole || home <= i))
+			continue;
+		t->slots[hole] = t->slots[i];
+		hole = i;
+	}
+	memset(&t->slots[hole], 0, sizeof(t->slots[hole]));
+	t->used--;
+}
+
+/*
+ * Makes room at the limit. A full scan per new source would not keep up
+ * with a flood of fresh addresses, so the idlest source in a run of slots
+ * from the home slot of the new one goes, an approximation of LRU. Only an
+ * empty run falls back to looking at all of them.
+ */
+static void top_evict_idlest(struct top_table *t, unsigned int start)
+{
+	unsigned int i, n, idlest = t->size;
+
+	for (i = start, n = 0; n < t->size; n++, i = (i + 1) & (t->size - 1)) {
+		if (n >= TOP_EVICT_SAMPLE && idlest < t->size)
+			break;
+		if (t->slots[i].used &&
+		    (idlest == t->size || t->slots[i].last_ns < t->slots[idlest].last_ns))
+			idlest = i;
+	}
+	if (idlest < t->size) {
+		top_remove(t, idlest);
+		t->evicted++;
+	}
+}
+
+static struct top_entry *top_find(struct top_table *t,
+				  const struct ieee802154_addr_sa *sa)
+{
+	struct top_entry *e;
+
+	e = top_slot(t->slots, t->size, addr_key(sa), sa->addr_type, sa->pan_id);
+	return e->used ? e : NULL;
+}
+
+static struct top_entry *top_lookup(struct top_table *t,
+				    const struct ieee802154_addr_sa *sa)
+{
+	uint64_t key = addr_key(sa);
+	struct top_entry *e;
+
+	e = top_slot(t->slots, t->size, key, sa->addr_type, sa->pan_id);
+	if (e->used)
+		return e;
+
+	if (t->used >= t->max)
+		top_evict_idlest(t, addr_hash(key, sa->addr_type, sa->pan_id, t->size));
+	/* Keep the load below 3/4 so probe chains stay short */
+	if ((t->used + 1) * 4 > t->size * 3 && top_table_grow(t))
+		return NULL;
+	e = top_slot(t->slots, t->size, key, sa->addr_type, sa->pan_id);
+
+	e->used = true;
+	e->key = key;
+	e->addr = *sa;
+	t->used++;
+	return e;
+}
+
+void top_account(struct top_table *t, const struct mac_header *h, uint32_t len,
+		 uint64_t ts_ns)
+{
+	struct ieee802154_addr_sa sa;
+	struct top_entry *e;
+
+	/* ACKs only carry the sequence number of the frame they answer */
+	if (h->type == MAC_FRAME_ACK && t->ack_pending && h->has_seq &&
+	    h->seq == t->ack_seq && ts_ns - t->ack_ns <= TOP_ACK_WAIT_NS) {
+		e = top_find(t, &t->ack_addr);
+		if (e)
+			e->acked++;
+		t->ack_pending = false;
+	}
+
+	if (h->src.addr_type == IEEE802154_ADDR_NONE) {
+		t->anon_frames++;
+		t->anon_bytes += len;
+		return;
+	}
+
+	sa = h->src;
+	if (!h->has_src_pan)
+		sa.pan_id = h->has_dst_pan ? h->dst.pan_id : TOP_PAN_UNKNOWN;
+	e = top_lookup(t, &sa);
+	if (!e)
+		return;
+
+	e->frames++;
+	e->bytes += len;
+	e->win_frames++;
+	e->win_bytes += len;
+
+	if (h->has_seq) {
+		/* Only frames asking for an ACK are sent again */
+		if (h->fc & MAC_FC_ACK_REQ && e->has_seq && h->seq == e->last_seq &&
+		    ts_ns - e->last_ns <= TOP_RETRY_NS)
+			e->retries++;
+		e->has_seq = true;
+		e->last_seq = h->seq;
+	}
+	e->last_ns = ts_ns;
+
+	if (h->fc & MAC_FC_ACK_REQ && h->has_seq) {
+		e->ack_req++;
+		t->ack_pending = true;
+		t->ack_seq = h->seq;
+		t->ack_ns = ts_ns;
+		t->ack_addr = sa;
+	}
+}
+
+void top_refresh(struct top_table *t, uint64_t interval_ns, uint64_t idle_before)
+{
+	struct top_entry *e;
+	unsigned int i;
+
+	for (i = 0; i < t->size; i++) {
+		e = &t->slots[i];
+		if (!e->used)
+			continue;
+		e->frame_rate = interval_ns ? e->win_frames * 1e9 / interval_ns : 0;
+		e->byte_rate = interval_ns ? e->win_bytes * 1e9 / interval_ns : 0;
+		e->win_frames = 0;
+		e->win_bytes = 0;
+	}
+
+	/* A removal shifts the next entry into the slot, look at it again */
+	for (i = 0; i < t->size;) {
+		if (t->slots[i].used && t->slots[i].last_ns < idle_before)
+			top_remove(t, i);
+		else
+			i++;
+	}
+}
+
+static int top_entry_cmp(const void *a, const void *b)
+{
+	const struct top_entry *ea = *(const struct top_entry **)a;
+	const struct top_entry *eb = *(const struct top_entry **)b;
+
+	if (ea->addr.pan_id != eb->addr.pan_id)
+		return ea->addr.pan_id < eb->addr.pan_id ? -1 : 1;
+	if (ea->byte_rate != eb->byte_rate)
+		return ea->byte_rate > eb->byte_rate ? -1 : 1;
+	if (ea->bytes != eb->bytes)
+		return ea->bytes > eb->bytes ? -1 : 1;
+	return ea->key < eb->key ? -1 : ea->key > eb->key;
+}
+
+struct top_entry **top_table_list(const struct top_table *t, unsigned int *num)
+{
+	struct top_entry **list;
+	unsigned int i, n = 0;
+
+	list = malloc((t->used ? t->used : 1) * sizeof(*list));
+	if (!list)
+		return NULL;
+
+	for (i = 0; i < t->size; i++)
+		if (t->slots[i].used)
+			list[n++] = &t->slots[i];
+	qsort(list, n, sizeof(*list), top_entry_cmp);
+
+	*num = n;
+	return list;
+}
@@ -0,0 +1,84 @@
+/*
+ * Per PAN and per source traffic accounting of wpan-top
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __WPAN_SNIFF_TOP_H
+#define __WPAN_SNIFF_TOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mac.h"
+
+/* Hard limit of tracked sources, the idlest one makes room for a new one */
+#define TOP_MAX_ENTRIES 4096
+/* Sources silent for this long are dropped at the next refresh */
+#define TOP_IDLE_S 60
+/* An ACK this soon after a frame with the same sequence number acknowledges it */
+#define TOP_ACK_WAIT_NS (10 * 1000000ULL)
+/* The same sequence number from the same source this soon again is a retry */
+#define TOP_RETRY_NS (50 * 1000000ULL)
+
+/* Frames without a PAN ID of their own are booked here */
+#define TOP_PAN_UNKNOWN 0xffff
+
+struct top_entry {
+	struct ieee802154_addr_sa addr; /* pan_id is the PAN the source sent on */
+	uint64_t key;
+	bool used;
+	bool has_seq;
+	uint8_t last_seq;
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t ack_req;	/* frames that asked for an ACK */
+	uint64_t acked;		/* ACKs seen for those */
+	uint64_t retries;	/* repeated sequence numbers */
+	uint64_t win_frames;	/* since the last refresh */
+	uint64_t win_bytes;
+	double frame_rate;	/* per second over the last refresh interval */
+	double byte_rate;
+	uint64_t last_ns;	/* frame clock of the last frame */
+};
+
+struct top_table {
+	struct top_entry *slots;
+	unsigned int size; /* power of two */
+	unsigned int used;
+	unsigned int max;
+	unsigned long evicted;
+	/* The frame waiting for its ACK */
+	bool ack_pending;
+	uint8_t ack_seq;
+	uint64_t ack_ns;
+	struct ieee802154_addr_sa ack_addr;
+	/* Frames without a source address, ACKs mostly */
+	uint64_t anon_frames;
+	uint64_t anon_bytes;
+};
+
+int top_table_init(struct top_table *t, unsigned int max);
+void top_table_free(struct top_table *t);
+/* Books a decoded frame of len bytes on air, received at ts_ns */
+void top_account(struct top_table *t, const struct mac_header *h, uint32_t len,
+		 uint64_t ts_ns);
+/*
+ * Turns the counts since the last call into rates over interval_ns and
+ * drops sources not heard from since idle_before.
+ */
+void top_refresh(struct top_table *t, uint64_t interval_ns, uint64_t idle_before);
+/* All entries, by PAN and then busiest first. The caller frees the array */
+struct top_entry **top_table_list(const struct top_table *t, unsigned int *num);
+
+#endif /* __WPAN_SNIFF_TOP_H */
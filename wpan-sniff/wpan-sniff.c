@@ -0,0 +1,400 @@
+/*
+ * Capture tool for IEEE 802.15.4 monitor interfaces
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/if_arp.h>
+
+#include "ring.h"
+#include "pcapng.h"
+#include "mac.h"
+#include "filter.h"
+#include "survey.h"
+
+#ifndef ARPHRD_IEEE802154_MONITOR
+#define ARPHRD_IEEE802154_MONITOR 805
+#endif
+
+#define WAIT_MS 1000
+#define MAC_FCS_LEN 2
+
+#ifdef HAVE_GETOPT_LONG
+static const struct option sniff_long_opts[] = {
+	{ "interface", required_argument, NULL, 'i' },
+	{ "write", required_argument, NULL, 'w' },
+	{ "filter", required_argument, NULL, 'f' },
+	{ "block-size", required_argument, NULL, 'B' },
+	{ "blocks", required_argument, NULL, 'n' },
+	{ "count", required_argument, NULL, 'c' },
+	{ "duration", required_argument, NULL, 't' },
+	{ "survey", optional_argument, NULL, 'S' },
+	{ "rounds", required_argument, NULL, 'r' },
+	{ "page", required_argument, NULL, 'p' },
+	{ "quiet", no_argument, NULL, 'q' },
+	{ "version", no_argument, NULL, 'v' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+#endif
+
+struct sniff_config {
+	const char *interface;
+	const char *write_path;
+	struct filter *filter;
+	unsigned int block_size;
+	unsigned int blocks;
+	unsigned long count;
+	unsigned int duration_s;
+	bool quiet;
+	unsigned int dwell_ms; /* survey mode if set */
+	unsigned int rounds;
+	int page;
+};
+
+static volatile sig_atomic_t sniff_stop;
+
+static void usage(const char *name)
+{
+	printf("Usage: %s OPTIONS\n"
+	"OPTIONS:\n"
+	"--interface | -i monitor interface to capture on (default monitor0)\n"
+	"--write | -w write the frames to this pcapng file, - for stdout\n"
+	"--filter | -f only keep frames matching this expression, see README\n"
+	"--block-size | -B size of one ring block in KiB (default %i)\n"
+	"--blocks | -n number of ring blocks (default %i)\n"
+	"--count | -c stop after this many frames\n"
+	"--duration | -t stop after this many seconds\n"
+	"--quiet | -q do not print a line per frame\n"
+	"--survey | -S[ms] hop over all channels, listening this long on each (default %i)\n"
+	"--rounds | -r survey rounds, 0 for ever (default 1)\n"
+	"--page | -p survey only the channels of this page\n"
+	"--version | -v print out version\n"
+	"--help This usage text\n", name, RING_BLOCK_SIZE / 1024, RING_BLOCKS,
+	SURVEY_DWELL_MS);
+}
+
+static void sniff_signal(int sig)
+{
+	sniff_stop = 1;
+}
+
+static void print_frame(const struct ring_frame *f, const struct mac_header *h,
+			bool decoded)
+{
+	char src[24], dst[24];
+
+	fprintf(stdout, "%llu.%06llu ", (unsigned long long)(f->ts_ns / 1000000000),
+		(unsigned long long)(f->ts_ns % 1000000000 / 1000));
+	if (!decoded) {
+		fprintf(stdout, "malformed len %u\n", f->len);
+		return;
+	}
+
+	fprintf(stdout, "%s", mac_type_name(h->type));
+	if (h->has_seq)
+		fprintf(stdout, " seq %u", h->seq);
+	if (h->has_dst_pan || h->has_src_pan)
+		fprintf(stdout, " pan 0x%04x", h->has_src_pan ? h->src.pan_id : h->dst.pan_id);
+	if (h->has_dst_pan && h->has_src_pan && h->src.pan_id != h->dst.pan_id)
+		fprintf(stdout, " > 0x%04x", h->dst.pan_id);
+	if (h->src.addr_type || h->dst.addr_type) {
+		mac_format_addr(src, &h->src);
+		mac_format_addr(dst, &h->dst);
+		fprintf(stdout, " %s > %s", src, dst);
+	}
+	fprintf(stdout, "%s%s%s len %u\n", h->fc & MAC_FC_SECURITY ? " sec" : "",
+		h->fc & MAC_FC_ACK_REQ ? " ackreq" : "",
+		h->fc & MAC_FC_PENDING ? " pending" : "", f->len);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int sniff(struct sniff_config *conf)
+{
+	struct pcapng_writer *w = NULL;
+	struct survey *survey = NULL;
+	struct ring_frame f;
+	struct ring_stats st;
+	struct sigaction sa;
+	struct ring *r;
+	uint64_t frames = 0, bytes = 0, filtered = 0, start, drain_until = 0;
+	struct mac_header h;
+	unsigned int fcs_len;
+	uint16_t linktype;
+	bool print, decoded = false;
+	int n, wait, ret = 0;
+
+	r = ring_open(conf->interface, conf->block_size, conf->blocks);
+	if (!r) {
+		perror(conf->interface);
+		return 1;
+	}
+
+	/* Monitors hand up frames with the FCS, wpan devices without */
+	if (ring_hwtype(r) == ARPHRD_IEEE802154_MONITOR) {
+		linktype = LINKTYPE_IEEE802_15_4_WITHFCS;
+		fcs_len = MAC_FCS_LEN;
+	} else {
+		linktype = LINKTYPE_IEEE802_15_4_NOFCS;
+		fcs_len = 0;
+		fprintf(stderr, "%s is not a monitor interface, capturing its own frames only\n",
+			conf->interface);
+	}
+
+	if (conf->write_path) {
+		w = pcapng_open(conf->write_path, conf->interface, linktype);
+		if (!w) {
+			perror(conf->write_path);
+			ring_close(r);
+			return 1;
+		}
+	}
+
+	if (conf->dwell_ms) {
+		survey = survey_open(conf->interface, conf->page, conf->dwell_ms,
+				     conf->rounds);
+		if (!survey) {
+			pcapng_close(w);
+			ring_close(r);
+			return 1;
+		}
+	}
+
+	/* No SA_RESTART, poll returns and the loop notices */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sniff_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fprintf(stderr, "capturing on %s, ring %u x %u KiB\n", conf->interface,
+		conf->blocks, conf->block_size / 1024);
+
+	print = !conf->quiet && !survey && !(w && !strcmp(conf->write_path, "-"));
+	start = now_ns();
+	while (!sniff_stop) {
+		if (conf->duration_s &&
+		    now_ns() - start >= conf->duration_s * 1000000000ULL)
+			break;
+
+		wait = WAIT_MS;
+		if (survey) {
+			if (!survey_timeout(survey)) {
+				n = survey_hop(survey);
+				if (n < 0) {
+					ret = 1;
+					break;
+				}
+				/* Frames of the last channel may still sit in an open block */
+				if (n > 0)
+					drain_until = now_ns() + 2 * RING_BLOCK_TIMEOUT_MS * 1000000ULL;
+			}
+			if (drain_until && now_ns() >= drain_until)
+				break;
+			if (survey_timeout(survey) < wait)
+				wait = survey_timeout(survey);
+			if (drain_until && wait > RING_BLOCK_TIMEOUT_MS)
+				wait = RING_BLOCK_TIMEOUT_MS;
+		}
+
+		n = ring_wait(r, wait);
+		if (n == -EINTR)
+			continue;
+		if (n < 0) {
+			errno = -n;
+			perror("poll");
+			ret = 1;
+			break;
+		}
+
+		while (ring_next(r, &f)) {
+			/* Only decode when something looks at the header */
+			if (conf->filter || print || survey) {
+				decoded = !mac_decode(f.data, f.caplen, fcs_len, &h);
+				if (conf->filter &&
+				    (!decoded || !filter_match(conf->filter, &h, f.len))) {
+					filtered++;
+					continue;
+				}
+			}
+			frames++;
+			bytes += f.len;
+			if (w) {
+				/* Full batches are flushed here, that can fail too */
+				n = pcapng_add(w, f.ts_ns, f.data, f.caplen, f.len);
+				if (n) {
+					errno = -n;
+					perror(conf->write_path);
+					ret = 1;
+					break;
+				}
+			}
+			if (print)
+				print_frame(&f, &h, decoded);
+			if (survey)
+				survey_account(survey, &f, &h, decoded, fcs_len);
+			if (conf->count && frames >= conf->count) {
+				sniff_stop = 1;
+				break;
+			}
+		}
+
+		if (ret)
+			break;
+
+		/* The frames point into the block, write them before giving it back */
+		if (w && pcapng_flush(w)) {
+			perror(conf->write_path);
+			ret = 1;
+			break;
+		}
+		ring_release(r);
+	}
+
+	if (survey) {
+		survey_report(survey, w && !strcmp(conf->write_path, "-") ? stderr : stdout);
+		survey_close(survey);
+	}
+
+	if (w && pcapng_close(w)) {
+		perror(conf->write_path);
+		ret = 1;
+	}
+
+	fprintf(stderr, "%llu frames (%llu bytes) captured\n",
+		(unsigned long long)frames, (unsigned long long)bytes);
+	if (conf->filter)
+		fprintf(stderr, "%llu frames did not match the filter\n",
+			(unsigned long long)filtered);
+	if (!ring_stats(r, &st))
+		fprintf(stderr, "kernel: %llu frames seen, %llu dropped, %llu ring freezes\n",
+			(unsigned long long)st.packets, (unsigned long long)st.drops,
+			(unsigned long long)st.freezes);
+
+	ring_close(r);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sniff_config conf;
+	long page = sysconf(_SC_PAGESIZE);
+	const char *err;
+	int c, ret;
+
+	mac_init();
+	memset(&conf, 0, sizeof(conf));
+	conf.interface = "monitor0";
+	conf.block_size = RING_BLOCK_SIZE;
+	conf.blocks = RING_BLOCKS;
+	conf.rounds = 1;
+	conf.page = -1;
+
+	while (1) {
+#ifdef HAVE_GETOPT_LONG
+		int opt_idx = -1;
+		c = getopt_long(argc, argv, "i:w:f:B:n:c:t:S::r:p:qvh", sniff_long_opts, &opt_idx);
+#else
+		c = getopt(argc, argv, "i:w:f:B:n:c:t:S::r:p:qvh");
+#endif
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'i':
+			conf.interface = optarg;
+			break;
+		case 'w':
+			conf.write_path = optarg;
+			break;
+		case 'f':
+			filter_free(conf.filter);
+			conf.filter = filter_compile(optarg, &err);
+			if (!conf.filter) {
+				printf("Bad filter expression at '%s'.\n", err);
+				return 1;
+			}
+			break;
+		case 'B':
+			conf.block_size = strtoul(optarg, NULL, 10) * 1024;
+			/* The kernel wants whole pages, a power of two keeps it simple */
+			if (conf.block_size < (unsigned long)page ||
+			    conf.block_size & (conf.block_size - 1)) {
+				printf("Block size must be a power of two of at least %li KiB.\n",
+				       page / 1024);
+				return 1;
+			}
+			break;
+		case 'n':
+			conf.blocks = strtoul(optarg, NULL, 10);
+			if (!conf.blocks) {
+				printf("The ring needs at least one block.\n");
+				return 1;
+			}
+			break;
+		case 'c':
+			conf.count = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			conf.duration_s = strtoul(optarg, NULL, 10);
+			break;
+		case 'S':
+			conf.dwell_ms = optarg ? strtoul(optarg, NULL, 10) : SURVEY_DWELL_MS;
+			if (!conf.dwell_ms) {
+				printf("Dwell time must be at least 1 ms.\n");
+				return 1;
+			}
+			break;
+		case 'r':
+			conf.rounds = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			conf.page = strtol(optarg, NULL, 10);
+			break;
+		case 'q':
+			conf.quiet = true;
+			break;
+		case 'v':
+			fprintf(stdout, "wpan-sniff 0.1\n");
+			return 1;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	ret = sniff(&conf);
+	filter_free(conf.filter);
+	return ret;
+}
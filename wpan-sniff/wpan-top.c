@@ -0,0 +1,381 @@
+/*
+ * Live traffic view of IEEE 802.15.4 monitor interfaces
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/if_arp.h>
+
+#include "ring.h"
+#include "mac.h"
+#include "filter.h"
+#include "top.h"
+
+#ifndef ARPHRD_IEEE802154_MONITOR
+#define ARPHRD_IEEE802154_MONITOR 805
+#endif
+
+#define TOP_DELAY_MS 1000
+#define MAC_FCS_LEN 2
+/* Screen lines besides the PAN and source rows */
+#define TOP_HEADER_LINES 6
+
+#ifdef HAVE_GETOPT_LONG
+static const struct option top_long_opts[] = {
+	{ "interface", required_argument, NULL, 'i' },
+	{ "filter", required_argument, NULL, 'f' },
+	{ "delay", required_argument, NULL, 'd' },
+	{ "iterations", required_argument, NULL, 'n' },
+	{ "batch", no_argument, NULL, 'b' },
+	{ "max-sources", required_argument, NULL, 'm' },
+	{ "idle", required_argument, NULL, 'e' },
+	{ "version", no_argument, NULL, 'v' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 },
+};
+#endif
+
+struct top_config {
+	const char *interface;
+	struct filter *filter;
+	unsigned int delay_ms;
+	unsigned long iterations;
+	bool batch;
+	unsigned int max_sources;
+	unsigned int idle_s;
+};
+
+/* Totals of one refresh interval, sources and anonymous frames alike */
+struct top_window {
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t filtered;
+	uint64_t malformed;
+};
+
+static volatile sig_atomic_t top_stop;
+
+static void usage(const char *name)
+{
+	printf("Usage: %s OPTIONS\n"
+	"OPTIONS:\n"
+	"--interface | -i monitor interface to watch (default monitor0)\n"
+	"--filter | -f only count frames matching this expression, see README.wpan-sniff\n"
+	"--delay | -d refresh interval in ms (default %i)\n"
+	"--iterations | -n stop after this many refreshes\n"
+	"--batch | -b print one report per refresh instead of redrawing the screen\n"
+	"--max-sources | -m sources kept at most (default %i)\n"
+	"--idle | -e forget sources silent for this many seconds (default %i,\n"
+	"                 0 keeps them until -m forces one out)\n"
+	"--version | -v print out version\n"
+	"--help This usage text\n", name, TOP_DELAY_MS, TOP_MAX_ENTRIES, TOP_IDLE_S);
+}
+
+static void top_signal(int sig)
+{
+	top_stop = 1;
+}
+
+static uint64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void format_ack_ratio(char *buf, uint64_t acked, uint64_t ack_req)
+{
+	if (ack_req)
+		snprintf(buf, 8, "%5.1f", 100.0 * acked / ack_req);
+	else
+		snprintf(buf, 8, "%5s", "-");
+}
+
+static unsigned int screen_rows(void)
+{
+	struct winsize ws;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) || !ws.ws_row)
+		return 24;
+	return ws.ws_row;
+}
+
+/* Returns the number of PANs printed */
+static unsigned int print_pans(struct top_entry **list, unsigned int num)
+{
+	uint64_t ack_req, acked, retries;
+	unsigned int i, j, sources, pans = 0;
+	double frame_rate, byte_rate;
+	char ack[8];
+
+	fprintf(stdout, "PAN     sources  frames/s   bytes/s  ack%%  retries\n");
+	/* The list comes sorted by PAN, sum up each run */
+	for (i = 0; i < num; i = j) {
+		frame_rate = byte_rate = 0;
+		ack_req = acked = retries = 0;
+		for (j = i; j < num && list[j]->addr.pan_id == list[i]->addr.pan_id; j++) {
+			frame_rate += list[j]->frame_rate;
+			byte_rate += list[j]->byte_rate;
+			ack_req += list[j]->ack_req;
+			acked += list[j]->acked;
+			retries += list[j]->retries;
+		}
+		sources = j - i;
+		format_ack_ratio(ack, acked, ack_req);
+		if (list[i]->addr.pan_id == TOP_PAN_UNKNOWN)
+			fprintf(stdout, "-     ");
+		else
+			fprintf(stdout, "0x%04x", list[i]->addr.pan_id);
+		fprintf(stdout, " %8u %9.1f %9.1f %s %8llu\n", sources, frame_rate,
+			byte_rate, ack, (unsigned long long)retries);
+		pans++;
+	}
+	return pans;
+}
+
+static void print_sources(struct top_entry **list, unsigned int num,
+			  unsigned int rows, uint64_t now)
+{
+	const struct top_entry *e;
+	char addr[24], ack[8];
+	unsigned int i;
+
+	fprintf(stdout, "PAN     source                   frames/s   bytes/s    frames  ack%%  retries    idle\n");
+	for (i = 0; i < num && i < rows; i++) {
+		e = list[i];
+		mac_format_addr(addr, &e->addr);
+		format_ack_ratio(ack, e->acked, e->ack_req);
+		if (e->addr.pan_id == TOP_PAN_UNKNOWN)
+			fprintf(stdout, "-     ");
+		else
+			fprintf(stdout, "0x%04x", e->addr.pan_id);
+		fprintf(stdout, "  %-23s %9.1f %9.1f %9llu %s %8llu %6.1fs\n", addr,
+			e->frame_rate, e->byte_rate, (unsigned long long)e->frames, ack,
+			(unsigned long long)e->retries,
+			now > e->last_ns ? (now - e->last_ns) / 1e9 : 0);
+	}
+	if (i < num)
+		fprintf(stdout, "... %u more\n", num - i);
+}
+
+static void print_screen(const struct top_config *conf, struct top_table *t,
+			 const struct top_window *win, uint64_t interval_ns,
+			 struct ring *r)
+{
+	struct top_entry **list;
+	struct ring_stats st;
+	unsigned int num, pans, rows;
+
+	list = top_table_list(t, &num);
+	if (!list)
+		return;
+	if (ring_stats(r, &st))
+		memset(&st, 0, sizeof(st));
+
+	if (!conf->batch)
+		fprintf(stdout, "\033[H\033[2J");
+	fprintf(stdout, "wpan-top on %s: %.1f frames/s, %.1f bytes/s, %u sources, "
+		"%lu evicted, %llu filtered, %llu malformed, %llu dropped by the kernel\n",
+		conf->interface, win->frames * 1e9 / interval_ns,
+		win->bytes * 1e9 / interval_ns, num, t->evicted,
+		(unsigned long long)win->filtered, (unsigned long long)win->malformed,
+		(unsigned long long)st.drops);
+	fprintf(stdout, "\n");
+	pans = print_pans(list, num);
+	fprintf(stdout, "\n");
+
+	/* Fit the screen, a batch report lists everything */
+	rows = num;
+	if (!conf->batch) {
+		rows = screen_rows();
+		rows = rows > TOP_HEADER_LINES + pans ? rows - TOP_HEADER_LINES - pans : 1;
+	}
+	print_sources(list, num, rows, clock_ns(CLOCK_REALTIME));
+	fflush(stdout);
+	free(list);
+}
+
+static int top(const struct top_config *conf)
+{
+	struct top_window win;
+	struct top_table t;
+	struct ring_frame f;
+	struct mac_header h;
+	struct sigaction sa;
+	struct ring *r;
+	uint64_t last, next, now;
+	unsigned long refreshes = 0;
+	unsigned int fcs_len;
+	int n, ret = 0;
+
+	r = ring_open(conf->interface, RING_BLOCK_SIZE, RING_BLOCKS);
+	if (!r) {
+		perror(conf->interface);
+		return 1;
+	}
+	if (ring_hwtype(r) == ARPHRD_IEEE802154_MONITOR) {
+		fcs_len = MAC_FCS_LEN;
+	} else {
+		fcs_len = 0;
+		fprintf(stderr, "%s is not a monitor interface, seeing its own frames only\n",
+			conf->interface);
+	}
+
+	if (top_table_init(&t, conf->max_sources)) {
+		perror("top_table_init");
+		ring_close(r);
+		return 1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = top_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	memset(&win, 0, sizeof(win));
+	last = clock_ns(CLOCK_MONOTONIC);
+	next = last + conf->delay_ms * 1000000ULL;
+	while (!top_stop) {
+		now = clock_ns(CLOCK_MONOTONIC);
+		if (now >= next) {
+			/* -e 0 never expires, -m still bounds the table */
+			top_refresh(&t, now - last, conf->idle_s ?
+				    clock_ns(CLOCK_REALTIME) -
+				    conf->idle_s * 1000000000ULL : 0);
+			print_screen(conf, &t, &win, now - last, r);
+			memset(&win, 0, sizeof(win));
+			if (conf->iterations && ++refreshes >= conf->iterations)
+				break;
+			last = now;
+			next = now + conf->delay_ms * 1000000ULL;
+		}
+
+		n = ring_wait(r, (next - now + 999999) / 1000000);
+		if (n == -EINTR)
+			continue;
+		if (n < 0) {
+			errno = -n;
+			perror("poll");
+			ret = 1;
+			break;
+		}
+
+		while (ring_next(r, &f)) {
+			if (mac_decode(f.data, f.caplen, fcs_len, &h)) {
+				win.malformed++;
+				continue;
+			}
+			if (conf->filter && !filter_match(conf->filter, &h, f.len)) {
+				win.filtered++;
+				continue;
+			}
+			win.frames++;
+			win.bytes += f.len;
+			top_account(&t, &h, f.len, f.ts_ns);
+		}
+		ring_release(r);
+	}
+
+	top_table_free(&t);
+	ring_close(r);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct top_config conf;
+	const char *err;
+	int c, ret;
+
+	mac_init();
+	memset(&conf, 0, sizeof(conf));
+	conf.interface = "monitor0";
+	conf.delay_ms = TOP_DELAY_MS;
+	conf.max_sources = TOP_MAX_ENTRIES;
+	conf.idle_s = TOP_IDLE_S;
+
+	while (1) {
+#ifdef HAVE_GETOPT_LONG
+		int opt_idx = -1;
+		c = getopt_long(argc, argv, "i:f:d:n:bm:e:vh", top_long_opts, &opt_idx);
+#else
+		c = getopt(argc, argv, "i:f:d:n:bm:e:vh");
+#endif
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'i':
+			conf.interface = optarg;
+			break;
+		case 'f':
+			filter_free(conf.filter);
+			conf.filter = filter_compile(optarg, &err);
+			if (!conf.filter) {
+				printf("Bad filter expression at '%s'.\n", err);
+				return 1;
+			}
+			break;
+		case 'd':
+			conf.delay_ms = strtoul(optarg, NULL, 10);
+			if (!conf.delay_ms) {
+				printf("Delay must be at least 1 ms.\n");
+				return 1;
+			}
+			break;
+		case 'n':
+			conf.iterations = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			conf.batch = true;
+			break;
+		case 'm':
+			conf.max_sources = strtoul(optarg, NULL, 10);
+			if (!conf.max_sources) {
+				printf("At least one source must be kept.\n");
+				return 1;
+			}
+			break;
+		case 'e':
+			conf.idle_s = strtoul(optarg, NULL, 10);
+			break;
+		case 'v':
+			fprintf(stdout, "wpan-top 0.1\n");
+			return 1;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	ret = top(&conf);
+	filter_free(conf.filter);
+	return ret;
+}